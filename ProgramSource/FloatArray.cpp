@@ -211,6 +211,110 @@ void FloatArray::scale(float factor){
 /// @note When built for ARM Cortex-M processor series, this method uses the optimized <a href="http://www.keil.com/pack/doc/CMSIS/General/html/index.html">CMSIS library</a>
   scale(factor, *this);
 }
+
+/* The ramp kernels below make a single pass, unrolled by four like the
+   CMSIS functions, with one multiply-accumulate per sample for the ramp.
+   The ramp is computed from the element index rather than accumulated,
+   and the last element gets the target itself, so that it is exact. */
+void FloatArray::scale(float from, float to, FloatArray destination){//supports in-place
+  ASSERT(destination.size >= size, "Array too small");
+  if(size == 0)
+    return;
+  float step = (to-from)/size;
+  float* src = data;
+  float* dst = destination.data;
+  int n = 1;
+  int blocks = (size-1) >> 2;
+  while(blocks--){
+    float gain = from+step*n;
+    *dst++ = *src++ * gain;
+    *dst++ = *src++ * (gain+step);
+    *dst++ = *src++ * (gain+2*step);
+    *dst++ = *src++ * (gain+3*step);
+    n += 4;
+  }
+  int remaining = (size-1) & 3;
+  while(remaining--)
+    *dst++ = *src++ * (from+step*n++);
+  *dst = *src * to;
+}
+
+void FloatArray::scale(float from, float to){
+  scale(from, to, *this);
+}
+
+void FloatArray::ramp(float from, float to){
+  float step = (to-from)/size;
+  for(int n=0; n<size-1; n++)
+    data[n] = from+step*(n+1);
+  if(size > 0)
+    data[size-1] = to;
+}
+
+void FloatArray::rampExponential(float from, float to){
+  ASSERT(from*to > 0, "Exponential ramp must not cross zero");
+  float ratio = powf(to/from, 1.0f/size);
+  float value = from;
+  for(int n=0; n<size; n++){
+    value *= ratio;
+    data[n] = value;
+  }
+  if(size > 0)
+    data[size-1] = to; // no rounding error at the block end
+}
+
+void FloatArray::crossfade(FloatArray operand2, float from, float to, FloatArray destination){
+  ASSERT(operand2.size >= size && destination.size >= size, "Array too small");
+  // a + (b-a)*mix
+  if(size == 0)
+    return;
+  float step = (to-from)/size;
+  float* a = data;
+  float* b = operand2.data;
+  float* dst = destination.data;
+  int n = 1;
+  int blocks = (size-1) >> 2;
+  while(blocks--){
+    float mix = from+step*n;
+    float a0 = *a++, a1 = *a++, a2 = *a++, a3 = *a++;
+    *dst++ = a0 + (*b++ - a0)*mix;
+    *dst++ = a1 + (*b++ - a1)*(mix+step);
+    *dst++ = a2 + (*b++ - a2)*(mix+2*step);
+    *dst++ = a3 + (*b++ - a3)*(mix+3*step);
+    n += 4;
+  }
+  int remaining = (size-1) & 3;
+  while(remaining--){
+    float a0 = *a++;
+    *dst++ = a0 + (*b++ - a0)*(from+step*n++);
+  }
+  float a0 = *a;
+  *dst = a0 + (*b - a0)*to;
+}
+
+void FloatArray::pan(float from, float to, FloatArray left, FloatArray right){
+  ASSERT(left.size >= size && right.size >= size, "Array too small");
+  // equal power gains at both ends, ramped linearly in between
+  float fromLeft = cosf(from*M_PI_2);
+  float fromRight = sinf(from*M_PI_2);
+  float toLeft = cosf(to*M_PI_2);
+  float toRight = sinf(to*M_PI_2);
+  float leftStep = (toLeft-fromLeft)/size;
+  float rightStep = (toRight-fromRight)/size;
+  float* src = data;
+  float* l = left.data;
+  float* r = right.data;
+  for(int n=1; n<size; n++){
+    float x = *src++; // read before writing, left may be this array
+    *l++ = x*(fromLeft+leftStep*n);
+    *r++ = x*(fromRight+rightStep*n);
+  }
+  if(size > 0){
+    float x = *src;
+    *l = x*toLeft;
+    *r = x*toRight;
+  }
+}
 void FloatArray::clip(){
   clip(1);
 }
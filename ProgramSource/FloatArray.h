@@ -188,6 +188,64 @@ public:
    * @param[in] factor the scaling factor
   */
   void scale(float factor);
+
+  /**
+   * Array by a linear gain ramp multiplication.
+   * Multiplies each element by a gain going linearly from **from** to **to**, reaching **to** on the last element.
+   * Use the parameter value of the previous block as **from** to remove zipper noise from gain changes.
+   * @param[in] from the gain before the first element
+   * @param[in] to the gain of the last element
+   * @param[out] destination the destination array
+  */
+  void scale(float from, float to, FloatArray destination);
+
+  /**
+   * Array by a linear gain ramp multiplication, in-place.
+   * @param[in] from the gain before the first element
+   * @param[in] to the gain of the last element
+  */
+  void scale(float from, float to);
+
+  /**
+   * Linear ramp.
+   * Sets the elements to values interpolated linearly from **from** to **to**, ending on **to** at the last element,
+   * so that consecutive blocks join up without a step.
+   * @param[in] from the value before the first element
+   * @param[in] to the value of the last element
+  */
+  void ramp(float from, float to);
+
+  /**
+   * Exponential ramp.
+   * Sets the elements to values interpolated exponentially from **from** to **to**, ending on **to** at the last element.
+   * Suited to frequencies and gains in dB, where a linear ramp sounds uneven.
+   * @param[in] from the value before the first element
+   * @param[in] to the value of the last element, with the same sign as **from** and both non-zero
+  */
+  void rampExponential(float from, float to);
+
+  /**
+   * Crossfade between arrays.
+   * Sets **destination** to this array faded into **operand2**, with a mix ramping linearly from **from** to **to**:
+   * 0 is only this array and 1 is only **operand2**.
+   * @param[in] operand2 the array to fade into
+   * @param[in] from the mix before the first element
+   * @param[in] to the mix of the last element
+   * @param[out] destination the destination array, may be this array or **operand2**
+  */
+  void crossfade(FloatArray operand2, float from, float to, FloatArray destination);
+
+  /**
+   * Equal power panning.
+   * Sets **left** and **right** to this array panned by a position going from **from** to **to**:
+   * 0 is hard left, 0.5 centre and 1 hard right. The channel gains are ramped linearly between
+   * their values at the two positions.
+   * @param[in] from the position before the first element
+   * @param[in] to the position of the last element
+   * @param[out] left the left channel destination, may be this array
+   * @param[out] right the right channel destination
+  */
+  void pan(float from, float to, FloatArray left, FloatArray right);
   
   /**
    * Clips the elements in the array in the range [-1, 1].
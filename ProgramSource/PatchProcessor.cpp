@@ -7,7 +7,10 @@
 #include "owlcontrol.h"
 
 PatchProcessor::PatchProcessor() 
-  : patch(NULL) {}
+  : patch(NULL), parameterChanges(NOF_PARAMETERS == 64 ? ~0ull : (1ull<<NOF_PARAMETERS)-1) {
+  // every parameter is reported as changed in the first block
+  memset(parameterValues, 0, sizeof(parameterValues));
+}
 
 PatchProcessor::~PatchProcessor(){
 }
@@ -23,8 +26,15 @@ void PatchProcessor::run(){
   for(;;){
     vector->programReady();
     buffer.split16(vector->audio_input, vector->audio_blocksize);
-    setParameterValues(vector->parameters);
+    setParameterValues(vector->parameters, vector->parameters_size);
+    uint64_t changes = parameterChanges;
+    while(changes){
+      int pid = __builtin_ctzll(changes);
+      patch->parameterChanged((PatchParameterId)pid, getParameterValue((PatchParameterId)pid), 0);
+      changes &= changes-1;
+    }
     patch->processAudio(buffer);
+    parameterChanges = 0;
     buffer.comb16(vector->audio_output);
   }
 }
@@ -34,35 +44,49 @@ void PatchProcessor::setPatch(Patch* p){
 }
 
 float PatchProcessor::getParameterValue(PatchParameterId pid){
-  if(pid < NOF_ADC_VALUES)
+  if(pid < NOF_PARAMETERS)
     return parameterValues[pid]/4096.0f;
   else
     return 0.0f;
 }
 
+/* set a parameter without smoothing, and flag it as changed if it is */
+void PatchProcessor::setParameterValue(PatchParameterId pid, int16_t value){
+  if(pid < NOF_PARAMETERS && parameterValues[pid] != value){
+    parameterValues[pid] = value;
+    parameterChanges |= 1ull<<pid;
+  }
+}
+
 #define SMOOTH_HYSTERESIS
 #define SMOOTH_FACTOR 3
 __attribute__ ((section (".coderam")))
-void PatchProcessor::setParameterValues(int16_t *params){
+void PatchProcessor::setParameterValues(int16_t *params, int size){
   /* Implements an exponential moving average (leaky integrator) to smooth ADC values
    * y(n) = (1-alpha)*y(n-1) + alpha*y(n)
    * with alpha=0.5, fs=48k, bs=128, then w0 ~= 18hz
+   * Parameters whose smoothed value moves are flagged in parameterChanges,
+   * so the hysteresis also sets the threshold for a change.
    */
-  for(int i=0; i<NOF_ADC_VALUES; ++i){
+  size = min(size, NOF_PARAMETERS);
+  for(int i=0; i<min(size, NOF_ADC_VALUES); ++i){
+    int16_t value = parameterValues[i];
 #ifdef SMOOTH_HYSTERESIS
     if(abs(params[i]-parameterValues[i]) > 7)
 #endif
       // 16 = half a midi step (4096/128=32)
 #ifdef OWLMODULAR
       if(i<4){
-	parameterValues[i] = (parameterValues[i]*SMOOTH_FACTOR + 4095 - params[i])/(SMOOTH_FACTOR+1);
+	value = (parameterValues[i]*SMOOTH_FACTOR + 4095 - params[i])/(SMOOTH_FACTOR+1);
       }else{
-	parameterValues[i] = (parameterValues[i]*SMOOTH_FACTOR - params[i])/(SMOOTH_FACTOR+1);
+	value = (parameterValues[i]*SMOOTH_FACTOR - params[i])/(SMOOTH_FACTOR+1);
       }
 #else /* OWLMODULAR */
-      parameterValues[i] = (parameterValues[i]*SMOOTH_FACTOR + params[i])/(SMOOTH_FACTOR+1);
+      value = (parameterValues[i]*SMOOTH_FACTOR + params[i])/(SMOOTH_FACTOR+1);
 #endif /* OWLMODULAR */
+    setParameterValue((PatchParameterId)i, value);
   }
-  // for(int i=NOF_ADC_VALUES; i<NOF_PARAMETERS; ++i)
-  //   // todo!
+  // the rest come from MIDI and sysex, and are not smoothed
+  for(int i=NOF_ADC_VALUES; i<size; ++i)
+    setParameterValue((PatchParameterId)i, params[i]);
 }
@@ -6,6 +6,10 @@
 #include "SampleBuffer.hpp"
 #include "device.h"
 
+#if NOF_PARAMETERS > 64
+#error "parameter changes are tracked in a 64-bit mask"
+#endif
+
 class PatchProcessor {
 public:  
   PatchProcessor();
@@ -14,11 +18,17 @@ public:
   void setPatch(Patch* patch);
   void run();
   float getParameterValue(PatchParameterId pid);
-  void setParameterValues(int16_t *parameters);
+  void setParameterValue(PatchParameterId pid, int16_t value);
+  void setParameterValues(int16_t *parameters, int size);
+  /* bitmask of the parameters that changed since the last block */
+  uint64_t getParameterChanges(){
+    return parameterChanges;
+  }
 private:
   Patch* patch;
   SampleBuffer buffer;
-  int16_t parameterValues[NOF_ADC_VALUES];
+  int16_t parameterValues[NOF_PARAMETERS];
+  uint64_t parameterChanges;
 };
 
 #endif // __PatchProcessor_h__
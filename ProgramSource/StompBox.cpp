@@ -40,6 +40,11 @@ float Patch::getParameterValue(PatchParameterId pid){
   // return 0.0;
 }
 
+/* true if the parameter changed since the last block, to skip recalculating what depends on it */
+bool Patch::isParameterChanged(PatchParameterId pid){
+  return pid < NOF_PARAMETERS && (processor->getParameterChanges() & (1ull<<pid));
+}
+
 AudioBuffer* Patch::createMemoryBuffer(int channels, int samples){
    MemoryBuffer* buf = new ManagedMemoryBuffer(channels, samples);
    ASSERT(buf != NULL, "malloc failed");
@@ -41,6 +41,7 @@ public:
   virtual ~Patch();
   void registerParameter(PatchParameterId pid, const char* name, const char* description = "");
   float getParameterValue(PatchParameterId pid);
+  bool isParameterChanged(PatchParameterId pid);
   bool isButtonPressed(PatchButtonId bid);
   int getSamplesSinceButtonPressed(PatchButtonId bid);
   void setButton(PatchButtonId bid, bool pressed);
@@ -50,6 +51,8 @@ public:
   float getElapsedBlockTime();
   int getElapsedCycles();
 public:
+  /* called before processAudio() for each parameter that changed since the last block */
+  virtual void parameterChanged(PatchParameterId pid, float value, int samples){}
   virtual void processAudio(AudioBuffer& output) = 0;
 private:
   PatchProcessor* processor;
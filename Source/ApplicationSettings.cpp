@@ -1,11 +1,61 @@
+#include <string.h>
 #include "ApplicationSettings.h"
-#include "eepromcontrol.h"
 #include "device.h"
 
-#define APPLICATION_SETTINGS_ADDR ADDR_FLASH_SECTOR_1
-#define APPLICATION_SETTINGS_SECTOR FLASH_Sector_1
+#define APPLICATION_SETTINGS_SECTOR_SIZE (16*1024)
+#define APPLICATION_SETTINGS_RECORD_SIZE ((sizeof(ApplicationSettings)+3) & ~3)
+#define APPLICATION_SETTINGS_RECORDS (APPLICATION_SETTINGS_SECTOR_SIZE/APPLICATION_SETTINGS_RECORD_SIZE)
 
-void ApplicationSettings::init(){
+/* kept outside the class, since its members are saved to flash as they are */
+static FlashBackend* flash;
+static uint32_t sectorAddress;
+
+static uint32_t readWord(uint32_t address){
+  return *(uint32_t*)address;
+}
+
+/*
+ * Settings are appended to the sector as a sequence of records, and the
+ * sector is only erased when it is full. The last record with a valid
+ * checksum holds the current settings. A record that was interrupted
+ * while being written has no checksum and is skipped.
+ */
+static uint32_t getRecordAddress(int index){
+  return sectorAddress + index*APPLICATION_SETTINGS_RECORD_SIZE;
+}
+
+static bool isRecordErased(int index){
+  uint32_t address = getRecordAddress(index);
+  for(uint32_t i=0; i<APPLICATION_SETTINGS_RECORD_SIZE; i+=4)
+    if(readWord(address+i) != 0xffffffff)
+      return false;
+  return true;
+}
+
+/* returns the index of the current record, or -1 if there is none */
+static int findLastRecord(uint32_t checksum){
+  int last = -1;
+  for(unsigned int i=0; i<APPLICATION_SETTINGS_RECORDS; ++i){
+    if(readWord(getRecordAddress(i)) == checksum)
+      last = i;
+    else if(isRecordErased(i))
+      break;
+  }
+  return last;
+}
+
+/* returns the index of the first unused record, or -1 if the sector is full */
+static int findFreeRecord(){
+  for(int i=APPLICATION_SETTINGS_RECORDS-1; i>=0; --i){
+    if(!isRecordErased(i))
+      return i+1 < (int)APPLICATION_SETTINGS_RECORDS ? i+1 : -1;
+  }
+  return 0;
+}
+
+void ApplicationSettings::init(FlashBackend& backend, uint32_t address){
+  flash = &backend;
+  sectorAddress = address;
   checksum = sizeof(*this) ^ 0xffffffff;
   if(settingsInFlash())
     loadFromFlash();
@@ -29,6 +79,7 @@ void ApplicationSettings::reset(){
   outputGainRight = AUDIO_OUTPUT_GAIN_RIGHT;
   program_index = DEFAULT_PROGRAM;
   program_change_button = true;
+  midi_parameter_interval = MIDI_PARAMETER_INTERVAL;
   input_offset = AUDIO_INPUT_OFFSET;
   input_scalar = AUDIO_INPUT_SCALAR;
   output_offset = AUDIO_OUTPUT_OFFSET;
@@ -36,24 +87,34 @@ void ApplicationSettings::reset(){
 }
 
 bool ApplicationSettings::settingsInFlash(){
-  return eeprom_read_word(APPLICATION_SETTINGS_ADDR) == checksum;
+  return findLastRecord(checksum) >= 0;
 }
 
 void ApplicationSettings::loadFromFlash(){
-  eeprom_read_block(APPLICATION_SETTINGS_ADDR, this, sizeof(*this));
+  int index = findLastRecord(checksum);
+  if(index >= 0)
+    memcpy(this, (void*)getRecordAddress(index), sizeof(*this));
 }
 
 void ApplicationSettings::saveToFlash(){
-  eeprom_unlock();
-  //   if(eeprom_erase(APPLICATION_SETTINGS_ADDR) == 0)
-  eeprom_erase_sector(APPLICATION_SETTINGS_SECTOR);
-  eeprom_write_block(APPLICATION_SETTINGS_ADDR, this, sizeof(*this));
-  eeprom_lock();
+  int index = findLastRecord(checksum);
+  if(index >= 0 && memcmp((void*)getRecordAddress(index), this, sizeof(*this)) == 0)
+    return; // nothing has changed
+  index = findFreeRecord();
+  flash->unlock();
+  if(index < 0){
+    flash->erase(sectorAddress);
+    index = 0;
+  }
+  uint32_t address = getRecordAddress(index);
+  // write the checksum last, to commit the record
+  if(flash->write(address+sizeof(checksum), (uint8_t*)this+sizeof(checksum), sizeof(*this)-sizeof(checksum)) == 0)
+    flash->write(address, &checksum, sizeof(checksum));
+  flash->lock();
 }
 
 void ApplicationSettings::clearFlash(){
-  eeprom_unlock();
-  eeprom_erase_sector(APPLICATION_SETTINGS_SECTOR);
-  //  eeprom_erase(APPLICATION_SETTINGS_ADDR);
-  eeprom_lock();
+  flash->unlock();
+  flash->erase(sectorAddress);
+  flash->lock();
 }
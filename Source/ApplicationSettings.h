@@ -3,6 +3,7 @@
 
 #include <inttypes.h>
 #include "stm32f4xx.h"
+#include "FlashBackend.h"
 
 enum I2SProtocol {
   I2S_PROTOCOL_PHILIPS = I2S_Standard_Phillips,
@@ -28,12 +29,13 @@ public:
   uint8_t audio_codec_protocol;
   uint8_t program_index;
   bool program_change_button;
+  uint8_t midi_parameter_interval;
   uint32_t input_offset;
   uint32_t input_scalar;
   uint32_t output_offset;
   uint32_t output_scalar;
 public:
-  void init();
+  void init(FlashBackend& backend, uint32_t address);
   void reset();
   bool settingsInFlash();
   void loadFromFlash();
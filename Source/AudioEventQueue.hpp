@@ -0,0 +1,84 @@
+#ifndef __AudioEventQueue_hpp__
+#define __AudioEventQueue_hpp__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define AUDIO_EVENT_QUEUE_SIZE 64 /* events, a power of two */
+
+enum AudioEventType {
+  AUDIO_EVENT_BUTTON = 0    /* button and MIDI note changes, value is the state or velocity */
+};
+
+struct AudioEvent {
+  volatile uint32_t sequence; // position + 1 once the event is written
+  uint8_t type;
+  uint8_t id;
+  int16_t value;
+  uint32_t time; // sample clock
+};
+
+/*
+ * Events from interrupts to the audio task, in the order they happened.
+ * Interrupts of different priorities may add events, so slots are
+ * reserved with a compare-and-swap and committed by writing their
+ * sequence number; the audio task is the only consumer and reads the
+ * events at the start of each block. Events that do not fit are dropped
+ * and counted.
+ */
+class AudioEventQueue {
+private:
+  AudioEvent events[AUDIO_EVENT_QUEUE_SIZE];
+  volatile uint32_t head;
+  volatile uint32_t tail;
+  volatile uint32_t dropped;
+public:
+  AudioEventQueue() : head(0), tail(0), dropped(0) {
+    for(int i=0; i<AUDIO_EVENT_QUEUE_SIZE; ++i)
+      events[i].sequence = 0;
+  }
+  /* called from interrupts */
+  bool push(uint8_t type, uint8_t id, int16_t value, uint32_t time){
+    uint32_t pos;
+    do{
+      pos = head;
+      if(pos - tail >= AUDIO_EVENT_QUEUE_SIZE){
+	__sync_fetch_and_add(&dropped, 1); // producers may preempt each other
+	return false;
+      }
+    }while(!__sync_bool_compare_and_swap(&head, pos, pos+1));
+    AudioEvent& event = events[pos & (AUDIO_EVENT_QUEUE_SIZE-1)];
+    event.type = type;
+    event.id = id;
+    event.value = value;
+    event.time = time;
+    __sync_synchronize();
+    event.sequence = pos+1; // commit
+    return true;
+  }
+  /* the oldest event, or NULL if there is none or it is still being written */
+  AudioEvent* front(){
+    uint32_t pos = tail;
+    AudioEvent& event = events[pos & (AUDIO_EVENT_QUEUE_SIZE-1)];
+    if(pos == head || event.sequence != pos+1)
+      return NULL;
+    return &event;
+  }
+  void pop(){
+    tail++;
+  }
+  /*
+   * discard the events written so far, when a new program starts. An
+   * event still being written is left for the new program: its slot
+   * cannot be skipped without the producer committing it over a later one.
+   */
+  void flush(){
+    while(front() != NULL)
+      pop();
+  }
+  uint32_t getDropped(){
+    return dropped;
+  }
+};
+
+#endif // __AudioEventQueue_hpp__
@@ -0,0 +1,114 @@
+#include <stddef.h>
+#include <string.h>
+#include "BackupStore.h"
+#include "bkp_sram.h"
+#include "crc32.h"
+#include "owlcontrol.h"
+#include "ProgramVector.h"
+#include "ProgramManager.h"
+#include "ApplicationSettings.h"
+
+BackupStore::BackupStore() : state(NULL), valid(false) {}
+
+uint32_t BackupStore::getChecksum(const void* data, uint32_t size){
+  return crc32(data, size, 0);
+}
+
+/* call after BKPSRAM_Init() */
+bool BackupStore::init(){
+  state = (BackupState*)BKPSRAM_GetMemoryAddress();
+  valid = state->magic == BACKUP_STORE_MAGIC && state->size == sizeof(BackupState) &&
+    state->checksum == getChecksum(state, offsetof(BackupState, checksum));
+  if(valid){
+    state->boot_count++;
+    state->checksum = getChecksum(state, offsetof(BackupState, checksum));
+  }else{
+    clear();
+  }
+  return valid;
+}
+
+void BackupStore::clear(){
+  memset(state, 0, sizeof(BackupState));
+  state->magic = BACKUP_STORE_MAGIC;
+  state->size = sizeof(BackupState);
+  state->checksum = getChecksum(state, offsetof(BackupState, checksum));
+  valid = false;
+}
+
+/* copy the current parameter values */
+void BackupStore::getParameters(int16_t* values){
+  ProgramVector* vector = getProgramVector();
+  if(vector->parameters == NULL || vector->parameters_size < NOF_PARAMETERS)
+    memcpy(values, getAnalogValues(), NOF_PARAMETERS*sizeof(int16_t));
+  else
+    memcpy(values, vector->parameters, NOF_PARAMETERS*sizeof(int16_t));
+}
+
+/*
+ * restore parameter values, except for those that are
+ * continuously updated from the ADC
+ */
+void BackupStore::setParameters(const int16_t* values){
+  ProgramVector* vector = getProgramVector();
+  int16_t* parameters = vector->parameters;
+  int size = vector->parameters_size;
+  if(parameters == NULL){
+    parameters = getAnalogValues();
+    size = NOF_PARAMETERS;
+  }
+  int i = parameters == getAnalogValues() ? NOF_ADC_VALUES : 0;
+  for(; i<size && i<NOF_PARAMETERS; ++i)
+    parameters[i] = values[i];
+}
+
+uint8_t BackupStore::getProgramIndex(){
+  return state->program_index;
+}
+
+void BackupStore::setProgramIndex(uint8_t index){
+  state->program_index = index;
+  state->checksum = getChecksum(state, offsetof(BackupState, checksum));
+}
+
+/* save program index, parameters and program stats */
+void BackupStore::saveState(){
+  state->program_index = settings.program_index;
+  getParameters(state->parameters);
+  state->cycles_per_block = program.getCyclesPerBlock();
+  state->heap_bytes_used = program.getHeapMemoryUsed();
+  state->checksum = getChecksum(state, offsetof(BackupState, checksum));
+  valid = true;
+}
+
+void BackupStore::restoreState(){
+  if(valid)
+    setParameters(state->parameters);
+}
+
+bool BackupStore::isPreset(uint8_t index){
+  if(index >= BACKUP_STORE_PRESETS)
+    return false;
+  BackupPreset* preset = &state->presets[index];
+  return preset->checksum == getChecksum(preset, offsetof(BackupPreset, checksum));
+}
+
+bool BackupStore::savePreset(uint8_t index){
+  if(index >= BACKUP_STORE_PRESETS)
+    return false;
+  BackupPreset* preset = &state->presets[index];
+  preset->program_index = settings.program_index;
+  getParameters(preset->parameters);
+  preset->checksum = getChecksum(preset, offsetof(BackupPreset, checksum));
+  return true;
+}
+
+bool BackupStore::recallPreset(uint8_t index){
+  if(!isPreset(index))
+    return false;
+  BackupPreset* preset = &state->presets[index];
+  setParameters(preset->parameters);
+  if(preset->program_index != settings.program_index)
+    program.changeProgram(preset->program_index, true);
+  return true;
+}
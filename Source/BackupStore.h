@@ -0,0 +1,62 @@
+#ifndef __BackupStore_h__
+#define __BackupStore_h__
+
+#include <stdint.h>
+#include "device.h"
+
+#define BACKUP_STORE_MAGIC           0xDADAB4C0
+#define BACKUP_STORE_PRESETS         8
+
+struct BackupPreset {
+  uint8_t program_index;
+  int16_t parameters[NOF_PARAMETERS];
+  uint32_t checksum;
+};
+
+struct BackupState {
+  uint32_t magic;
+  uint32_t size;
+  uint32_t boot_count;
+  uint8_t program_index;
+  int16_t parameters[NOF_PARAMETERS];
+  uint32_t cycles_per_block;
+  uint32_t heap_bytes_used;
+  uint32_t checksum;
+  BackupPreset presets[BACKUP_STORE_PRESETS];
+};
+
+/*
+ * Persistent state kept in the 4k battery backed SRAM.
+ * Holds the last program and parameter values, the most recent program
+ * stats, and a small number of preset snapshots. Writes are plain memory
+ * writes, so saving and recalling presets is fast enough to do from the
+ * MIDI interrupt. Recalling a preset of another program leaves the program
+ * change to the program manager task. Contents survive a reset, and a
+ * power cycle if VBAT is connected.
+ */
+class BackupStore {
+private:
+  BackupState* state;
+  bool valid;
+  uint32_t getChecksum(const void* data, uint32_t size);
+  void getParameters(int16_t* values);
+  void setParameters(const int16_t* values);
+public:
+  BackupStore();
+  bool init();
+  void clear();
+  bool isValid(){
+    return valid;
+  }
+  uint8_t getProgramIndex();
+  void setProgramIndex(uint8_t index);
+  void saveState();
+  void restoreState();
+  bool savePreset(uint8_t index);
+  bool recallPreset(uint8_t index);
+  bool isPreset(uint8_t index);
+};
+
+extern BackupStore backup;
+
+#endif // __BackupStore_h__
@@ -0,0 +1,159 @@
+#include <string.h>
+#include "DeferredLog.h"
+#include "MidiController.h"
+#include "OpenWareMidiControl.h"
+#include "clock.h"
+
+DeferredLog::DeferredLog() : head(0), tail(0), dropped(0) {
+  memset(entries, 0, sizeof(entries));
+  memset(limiters, 0, sizeof(limiters));
+}
+
+/* called from any task or interrupt */
+__attribute__ ((section (".coderam")))
+bool DeferredLog::log(const char* format, const uint32_t* args, int nargs){
+  uint32_t now = getSysTicks();
+  // rate limit repeats of the same message, keyed by its format
+  uint32_t suppressed = 0;
+  if(format != NULL){
+    int slot = ((uint32_t)format >> 2) & (DEFERRED_LOG_LIMITERS-1);
+    if(limiters[slot].format == format && now - limiters[slot].time < DEFERRED_LOG_RATE_LIMIT_MS){
+      limiters[slot].suppressed++;
+      return false;
+    }
+    suppressed = limiters[slot].format == format ? limiters[slot].suppressed : 0;
+    limiters[slot].format = format;
+    limiters[slot].time = now;
+    limiters[slot].suppressed = 0;
+  }
+  uint32_t pos;
+  do{
+    pos = head;
+    if(pos - tail >= DEFERRED_LOG_SIZE){
+      dropped++;
+      return false;
+    }
+  }while(!__sync_bool_compare_and_swap(&head, pos, pos+1));
+  DeferredLogEntry& entry = entries[pos & (DEFERRED_LOG_SIZE-1)];
+  entry.format = format;
+  for(int i=0; i<DEFERRED_LOG_ARGS; ++i)
+    entry.args[i] = i < nargs ? args[i] : 0;
+  entry.timestamp = now;
+  entry.suppressed = suppressed;
+  entry.sequence = pos+1; // commit
+  return true;
+}
+
+static char* append(char* p, char* end, const char* str){
+  while(*str && p < end)
+    *p++ = *str++ & 0x7f; // a byte over 0x7f would end the sysex message
+  return p;
+}
+
+static char* append(char* p, char* end, uint32_t value, int base, bool sign){
+  char digits[12];
+  int i = 0;
+  bool negative = sign && (int32_t)value < 0;
+  if(negative)
+    value = -value;
+  do{
+    digits[i++] = "0123456789abcdef"[value % base];
+    value /= base;
+  }while(value);
+  if(negative && p < end)
+    *p++ = '-';
+  while(i > 0 && p < end)
+    *p++ = digits[--i];
+  return p;
+}
+
+int DeferredLog::format(char* buffer, int size, DeferredLogEntry& entry){
+  char* p = buffer;
+  char* end = buffer+size;
+  const char* f = entry.format;
+  int arg = 0;
+  while(*f && p < end){
+    if(*f != '%'){
+      *p++ = *f++;
+      continue;
+    }
+    f++;
+    uint32_t value = arg < DEFERRED_LOG_ARGS ? entry.args[arg] : 0;
+    switch(*f){
+    case 'd':
+    case 'i':
+      p = append(p, end, value, 10, true);
+      arg++;
+      break;
+    case 'u':
+      p = append(p, end, value, 10, false);
+      arg++;
+      break;
+    case 'x':
+      p = append(p, end, value, 16, false);
+      arg++;
+      break;
+    case 'c':
+      *p++ = (char)(value & 0x7f);
+      arg++;
+      break;
+    case 's':
+      p = append(p, end, value ? (const char*)value : "(null)");
+      arg++;
+      break;
+    case 'f': {
+      float fv;
+      memcpy(&fv, &value, sizeof(fv));
+      if(fv < 0 && p < end){
+	*p++ = '-';
+	fv = -fv;
+      }
+      uint32_t whole = fv;
+      p = append(p, end, whole, 10, false);
+      if(p < end)
+	*p++ = '.';
+      uint32_t fraction = (fv - whole)*1000;
+      if(fraction < 100 && p < end)
+	*p++ = '0';
+      if(fraction < 10 && p < end)
+	*p++ = '0';
+      p = append(p, end, fraction, 10, false);
+      arg++;
+      break;
+    }
+    case '%':
+      *p++ = '%';
+      break;
+    case '\0':
+      continue;
+    default:
+      *p++ = *f;
+      break;
+    }
+    f++;
+  }
+  if(entry.suppressed && p < end){
+    p = append(p, end, " (+");
+    p = append(p, end, entry.suppressed, 10, false);
+    p = append(p, end, ")");
+  }
+  return p - buffer;
+}
+
+/* format and send the logged messages, called from the manager task */
+void DeferredLog::flush(){
+  while(tail != head){
+    DeferredLogEntry& entry = entries[tail & (DEFERRED_LOG_SIZE-1)];
+    if(entry.sequence != tail+1)
+      break; // reserved but not yet written
+    char buffer[64];
+    buffer[0] = SYSEX_PROGRAM_MESSAGE;
+    int len = 1;
+    if(entry.format != NULL)
+      len += format(buffer+1, sizeof(buffer)-1, entry);
+    // leave the message for the next flush if the transmit queue is full
+    if(!midi.sendSysEx((uint8_t*)buffer, len))
+      break;
+    tail++;
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef __DeferredLog_h__
+#define __DeferredLog_h__
+
+#include <stdint.h>
+
+#define DEFERRED_LOG_SIZE           32  /* entries, a power of two */
+#define DEFERRED_LOG_ARGS           4
+#define DEFERRED_LOG_LIMITERS       16  /* a power of two */
+#define DEFERRED_LOG_RATE_LIMIT_MS  100 /* minimum time between repeats of a message */
+#define DEFERRED_LOG_FLUSH_MS       50  /* how often the manager task sends the log */
+
+struct DeferredLogEntry {
+  volatile uint32_t sequence; // position + 1 once the entry is written
+  const char* format;
+  uint32_t args[DEFERRED_LOG_ARGS];
+  uint32_t timestamp;
+  uint32_t suppressed; // repeats dropped by the rate limit before this one
+};
+
+/*
+ * Log messages that are formatted later, so that logging is cheap and
+ * safe from the audio task and from interrupts. A message is stored as
+ * its printf style format and up to four 32-bit arguments, in a lock-free
+ * multi-producer ring; the manager task formats the messages and sends
+ * them as program messages. The format, and any %s arguments, must stay
+ * valid until then: use string literals.
+ * Supported conversions are %d %i %u %x %c %s %f and %%, where a %f
+ * argument holds the bits of a float.
+ */
+class DeferredLog {
+private:
+  DeferredLogEntry entries[DEFERRED_LOG_SIZE];
+  volatile uint32_t head;
+  uint32_t tail;
+  struct {
+    const char* format;
+    uint32_t time;
+    uint32_t suppressed;
+  } limiters[DEFERRED_LOG_LIMITERS];
+  volatile uint32_t dropped;
+  int format(char* buffer, int size, DeferredLogEntry& entry);
+public:
+  DeferredLog();
+  bool log(const char* format, const uint32_t* args, int nargs);
+  bool log(const char* format, int32_t a = 0, int32_t b = 0){
+    uint32_t args[2] = { (uint32_t)a, (uint32_t)b };
+    return log(format, args, 2);
+  }
+  void flush();
+  uint32_t getDropped(){
+    return dropped;
+  }
+};
+
+extern DeferredLog debugLog;
+
+#endif // __DeferredLog_h__
@@ -3,6 +3,7 @@
 
 #include "PatchDefinition.hpp"
 #include "ProgramHeader.h"
+#include "crc32.h"
 
 class DynamicPatchDefinition : public PatchDefinition {
 private:
@@ -12,6 +13,8 @@ private:
   uint32_t* jumpAddress;
   uint32_t* programAddress;
   uint32_t programSize;
+  uint32_t checksum;
+  bool hasChecksum;
   ProgramHeader* header;
   char programName[24];
 public:
@@ -34,27 +37,95 @@ public:
     programVector = header->programVector;
     strlcpy(programName, header->programName, sizeof(programName));
     programFunction = (ProgramFunction)jumpAddress;
+    hasChecksum = false;
+    if(isProgramHeaderV2(header)){
+      inputs = header->inputs;
+      outputs = header->outputs;
+    }else{
+      inputs = 2;
+      outputs = 2;
+    }
+    return true;
+  }
+  /* set the expected crc32 of the program image, checked when it is copied */
+  void setChecksum(uint32_t crc){
+    checksum = crc;
+    hasChecksum = true;
+  }
+  /* check that the memory a program declares is available, without loading it */
+  static bool checkResources(ProgramHeader* hdr){
+    if(!isProgramHeader(hdr))
+      return false;
+    uint32_t limit;
+    if(hdr->linkAddress == (uint32_t*)PATCHRAM)
+      limit = PATCHRAM+80*1024;
+    else if(hdr->linkAddress == (uint32_t*)EXTRAM)
+      limit = EXTRAM+1024*1024;
+    else
+      return false;
+    if(hdr->endAddress < hdr->linkAddress || (uint32_t)hdr->endAddress > limit)
+      return false;
+    if(isProgramHeaderV2(hdr)){
+      if(hdr->headerSize > (uint32_t)hdr->endAddress - (uint32_t)hdr->linkAddress)
+	return false;
+      ProgramSection* bss = &hdr->sections[PROGRAM_SECTION_BSS];
+      if(bss->end < bss->begin ||
+	 (bss->end != bss->begin && (bss->begin < hdr->endAddress || (uint32_t)bss->end > limit)))
+	return false;
+      extern char _EXTRAM, _EXTRAM_END;
+      extern char _CCMRAM, _CCMRAM_END;
+      if(hdr->ccmHeapSize > (uint32_t)(&_CCMRAM_END - &_CCMRAM) ||
+	 hdr->extHeapSize > (uint32_t)(&_EXTRAM_END - &_EXTRAM))
+	return false;
+    }
     return true;
   }
   void copy(){
     /* copy program to ram */
     if((linkAddress == (uint32_t*)PATCHRAM && programSize <= 80*1024) ||
        (linkAddress == (uint32_t*)EXTRAM && programSize <= 1024*1024)){
-      memcpy((void*)linkAddress, (void*)programAddress, programSize);
+      if(isProgramHeaderV2(header)){
+	// copy the header, then copy and checksum the image in a single pass
+	uint32_t hs = header->headerSize;
+	uint32_t crc = header->checksum;
+	memcpy((void*)linkAddress, (void*)programAddress, hs);
+	if(crc32_copy((uint8_t*)linkAddress+hs, (uint8_t*)programAddress+hs, programSize-hs, 0) != crc){
+	  programFunction = NULL;
+	  return;
+	}
+      }else if(hasChecksum){
+	// copy and checksum in a single pass
+	uint32_t crc = crc32_copy((void*)linkAddress, (void*)programAddress, programSize, 0);
+	if(crc != checksum){
+	  programFunction = NULL;
+	  return;
+	}
+      }else{
+	memcpy((void*)linkAddress, (void*)programAddress, programSize);
+      }
       // memmove((void*)linkAddress, (void*)programAddress, programSize);
-      if(programAddress == (uint32_t*)EXTRAM)
+      if(programAddress == (uint32_t*)EXTRAM){
 	// avoid copying dynamic patch again after reset
-	programAddress = linkAddress; 
+	programAddress = linkAddress;
+	header = (ProgramHeader*)linkAddress;
+      }
     }else{
       programFunction = NULL;
     }
   }
+  /* zero initialise bss, for v2 programs which declare it */
+  void clear(){
+    if(isProgramHeaderV2(header)){
+      ProgramSection* bss = &header->sections[PROGRAM_SECTION_BSS];
+      memset((void*)bss->begin, 0, (uint32_t)bss->end - (uint32_t)bss->begin);
+    }
+  }
   bool verify(){
     // check we've got an entry function
     if(programFunction == NULL)
       return false;
-    // check magic
-    if(*(uint32_t*)programAddress != 0xDADAC0DE)
+    // check magic and declared resources
+    if(!checkResources((ProgramHeader*)programAddress))
       return false;
     // sanity-check stack base address and size
     uint32_t sb = (uint32_t)stackBase;
@@ -68,8 +139,16 @@ public:
   void run(){
     if(linkAddress != programAddress)
       copy();
-    if(verify())
+    if(verify()){
+      clear();
       programFunction();
+    }
+  }
+  const char* getParameterName(uint8_t pid){
+    if(isProgramHeaderV2(header) && pid < PROGRAM_HEADER_PARAMETERS &&
+       header->parameterNames[pid][0] != '\0')
+      return header->parameterNames[pid];
+    return NULL;
   }
   uint32_t getProgramSize(){
     return programSize;
@@ -1,11 +1,16 @@
 #ifndef __FirmwareLoader_H__
 #define __FirmwareLoader_H__
 
-#include <math.h>
+#include <stddef.h>
 #include "crc32.h"
 #include "sysex.h"
+#include "ProgramManager.h"
+#include "DynamicPatchDefinition.hpp"
 // #include "device.h"
 
+/* decoded data held back until the running program has released its memory */
+#define FIRMWARE_LOADER_STAGING_SIZE 1024
+
 class FirmwareLoader {
 private:
   // enum SysexFirmwareStatus {
@@ -20,11 +25,22 @@ private:
   uint32_t index;
   uint32_t crc;
   bool ready;
+  uint8_t staging[FIRMWARE_LOADER_STAGING_SIZE];
+  uint32_t staged;
+
+  /* move staged data to the buffer once the program has stopped */
+  void unstage(){
+    if(staged > 0 && !program.isProgramRunning()){
+      memcpy(buffer+index-staged, staging, staged);
+      staged = 0;
+    }
+  }
 public:
   void clear(){
     // free(buffer);
     buffer = NULL;
     index = 0;
+    staged = 0;
     packageIndex = 0;
     ready = false;
     crc = -1;
@@ -69,8 +85,6 @@ public:
       // first package
       if(length < 3+5+5)
 	return error("Invalid sysex package");
-      // stop running program and free its memory
-      exitProgram(true);
       // get firmware data size (decoded)
       size = decodeInt(data+offset);
       offset += 5; // it takes five 7-bit values to encode four bytes
@@ -78,21 +92,46 @@ public:
       if(size > MAX_SYSEX_FIRMWARE_SIZE)
 	return error("Sysex too big");
       buffer = (uint8_t*)EXTRAM;
+      crc = 0;
       return 0;
     }
     if(++packageIndex != idx)
       return error("Sysex package out of sequence"); // out of sequence package
-    int len = floor((length-offset)*7/8.0f);
-    // wait for program to exit before writing to buffer
+    uint32_t len = (length-offset)*7/8; // decoded size
+    if((index == 0 || staged > 0) && index+len <= size){
+      // the running program may still be using the buffer: decode to
+      // the staging area until the program manager has stopped it
+      if(staged+len > sizeof(staging))
+	return error("Program did not stop");
+      len = sysex_to_data(data+offset, staging+staged, length-offset);
+      if(index == 0){
+	// first data package: reject a patch that won't fit before
+	// stopping the running program
+	ProgramHeader* header = (ProgramHeader*)staging;
+	if(len >= offsetof(ProgramHeader, parameterNames) && isProgramHeader(header) &&
+	   !DynamicPatchDefinition::checkResources(header))
+	  return error("Program does not fit in memory");
+	// stop running program and free its memory
+	exitProgram(true);
+      }
+      crc = crc32(staging+staged, len, crc);
+      staged += len;
+      index += len;
+      unstage();
+      return 0;
+    }
     if(index+len <= size){
       // mid package
       len = sysex_to_data(data+offset, buffer+index, length-offset);
+      // update checksum with each package as it is decoded
+      crc = crc32(buffer+index, len, crc);
       index += len;
       return 0;
     }else if(index == size){
       // last package: package index and checksum
-      // check crc
-      crc = crc32(buffer, size, 0);
+      unstage();
+      if(staged > 0)
+	return error("Program did not stop");
       // get checksum: last 4 bytes of buffer
       uint32_t checksum = decodeInt(data+length-5);
       if(crc != checksum)
@@ -0,0 +1,21 @@
+#ifndef __FlashBackend_h__
+#define __FlashBackend_h__
+
+#include <stdint.h>
+
+/*
+ * Write access to NOR flash, which is read through memory mapped addresses.
+ * Programming can only clear bits: a word must be erased before it can be
+ * programmed to an arbitrary value, and erasing sets a whole sector to 0xff.
+ */
+class FlashBackend {
+public:
+  virtual void unlock() = 0;
+  virtual void lock() = 0;
+  /* erase the sector that contains address */
+  virtual int erase(uint32_t address) = 0;
+  /* program size bytes, rounded up to whole words */
+  virtual int write(uint32_t address, void* data, uint32_t size) = 0;
+};
+
+#endif // __FlashBackend_h__
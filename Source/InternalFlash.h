@@ -0,0 +1,24 @@
+#ifndef __InternalFlash_h__
+#define __InternalFlash_h__
+
+#include "FlashBackend.h"
+#include "eepromcontrol.h"
+
+/* the on-chip flash memory */
+class InternalFlash : public FlashBackend {
+public:
+  void unlock(){
+    eeprom_unlock();
+  }
+  void lock(){
+    eeprom_lock();
+  }
+  int erase(uint32_t address){
+    return eeprom_erase(address);
+  }
+  int write(uint32_t address, void* data, uint32_t size){
+    return eeprom_write_block(address, data, size);
+  }
+};
+
+#endif // __InternalFlash_h__
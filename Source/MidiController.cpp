@@ -9,6 +9,10 @@
 #include "OpenWareMidiControl.h"
 #include "ProgramVector.h"
 #include "ProgramManager.h"
+#include "ProgramHeader.h"
+#include "Telemetry.h"
+#include "sysex.h"
+#include "clock.h"
 #include "Owl.h"
 #include <math.h> /* for ceilf */
 
@@ -18,6 +22,58 @@ uint32_t log2(uint32_t x){
 
 void MidiController::init(uint8_t ch){
   channel = ch;
+  parameterChanged = 0;
+  telemetryInterval = 0;
+  // no value has been sent yet
+  memset((void*)parameterValues, 0xff, sizeof(parameterValues));
+  memset(parameterSent, 0xff, sizeof(parameterSent));
+}
+
+/*
+ * Record the latest value of a patch parameter, to be sent as a CC by
+ * sendParameterValues(). Called from the audio task, possibly every block.
+ */
+void MidiController::setParameterValue(uint8_t pid, int16_t value){
+  if(pid > PARAMETER_BH)
+    return;
+  uint8_t cc = (value>>5) & 0x7f;
+  if(parameterValues[pid] != cc){
+    parameterValues[pid] = cc;
+    __sync_fetch_and_or(&parameterChanged, 1u<<pid);
+  }
+}
+
+static uint8_t getParameterCc(uint8_t pid){
+  switch(pid){
+  case PARAMETER_F:
+    return PATCH_PARAMETER_F;
+  case PARAMETER_G:
+    return PATCH_PARAMETER_G;
+  case PARAMETER_H:
+    return PATCH_PARAMETER_H;
+  default:
+    if(pid >= PARAMETER_AA)
+      return PATCH_PARAMETER_AA+(pid-PARAMETER_AA);
+    return PATCH_PARAMETER_A+pid;
+  }
+}
+
+/* send parameters that have changed since the last call, called from the USB interrupt */
+void MidiController::sendParameterValues(){
+  uint32_t changed = __sync_fetch_and_and(&parameterChanged, 0);
+  while(changed){
+    uint8_t pid = __builtin_ctz(changed);
+    changed &= changed-1;
+    uint8_t value = parameterValues[pid];
+    if(value != parameterSent[pid]){
+      if(!sendCc(getParameterCc(pid), value)){
+	// no room in the transmit queue: try again on the next call
+	__sync_fetch_and_or(&parameterChanged, changed | (1u<<pid));
+	break;
+      }
+      parameterSent[pid] = value;
+    }
+  }
 }
 
 void MidiController::sendPatchParameterValues(){
@@ -59,9 +115,23 @@ void MidiController::sendSettings(){
   sendConfigurationSetting((const char*)SYSEX_CONFIGURATION_CODEC_HALFSPEED, settings.audio_codec_halfspeed);
   sendConfigurationSetting((const char*)SYSEX_CONFIGURATION_CODEC_SWAP, settings.audio_codec_swaplr);
   sendConfigurationSetting((const char*)SYSEX_CONFIGURATION_PC_BUTTON, settings.program_change_button);
+  sendConfigurationSetting((const char*)SYSEX_CONFIGURATION_MIDI_INTERVAL, settings.midi_parameter_interval);
 }
 
+/* send parameter names declared in the program header, without running the program */
 void MidiController::sendPatchParameterNames(){
+  PatchDefinition* def = registry.getPatchDefinition(settings.program_index);
+  if(def != NULL){
+    char name[PROGRAM_HEADER_PARAMETER_NAME_SIZE+1];
+    for(int i=0; i<PROGRAM_HEADER_PARAMETERS; ++i){
+      const char* nm = def->getParameterName(i);
+      if(nm != NULL){
+	strncpy(name, nm, PROGRAM_HEADER_PARAMETER_NAME_SIZE);
+	name[PROGRAM_HEADER_PARAMETER_NAME_SIZE] = '\0';
+	sendPatchParameterName((PatchParameterId)i, name);
+      }
+    }
+  }
   // PatchProcessor* processor = patches.getActivePatchProcessor();
   // for(int i=0; i<NOF_ADC_VALUES; ++i){
   //   PatchParameterId pid = (PatchParameterId)i;
@@ -127,7 +197,7 @@ char* itoa(int val, int base, int pad=0){
 
 void MidiController::sendDeviceStats(){
 #ifdef DEBUG_STACK
-  char buffer[64];
+  char buffer[96];
   buffer[0] = SYSEX_DEVICE_STATS;
   char* p = &buffer[1];
   p = stpcpy(p, (const char*)"Program Stack ");
@@ -140,10 +210,49 @@ void MidiController::sendDeviceStats(){
   p = stpcpy(p, itoa(program.getManagerStackAllocation(), 10));
   p = stpcpy(p, (const char*)" Free ");
   p = stpcpy(p, itoa(program.getFreeHeapSize(), 10));
+  p = stpcpy(p, (const char*)" MIDI drops ");
+  p = stpcpy(p, itoa(midi_tx_dropped(MIDI_TX_CHANNEL), 10));
+  p = stpcpy(p, (const char*)"/");
+  p = stpcpy(p, itoa(midi_tx_dropped(MIDI_TX_SYSEX), 10));
   sendSysEx((uint8_t*)buffer, p-buffer);
 #endif /* DEBUG_STACK */
 }
 
+/*
+ * binary status frame, for tools that poll the device.
+ * Called only from the manager task: the frame is kept off its small stack.
+ */
+void MidiController::sendTelemetry(){
+  static TelemetryFrame frame;
+  static uint8_t buffer[1+TELEMETRY_SYSEX_SIZE];
+  memset(&frame, 0, sizeof(frame));
+  frame.version = TELEMETRY_VERSION;
+  frame.error = getErrorStatus();
+  frame.timestamp = getSysTicks();
+#ifdef DEBUG_DWT
+  frame.cycles_per_block = program.getCyclesPerBlock();
+  frame.cpu_load = frame.cycles_per_block*1000/(settings.audio_blocksize*ARM_CYCLES_PER_SAMPLE);
+#endif /* DEBUG_DWT */
+  frame.heap_bytes_used = program.getHeapMemoryUsed();
+#ifdef DEBUG_STACK
+  frame.program_stack_used = program.getProgramStackUsed();
+  frame.free_heap = program.getFreeHeapSize();
+#endif /* DEBUG_STACK */
+  frame.audio_overruns = getAudioOverruns();
+  frame.midi_tx_dropped[0] = midi_tx_dropped(MIDI_TX_CHANNEL);
+  frame.midi_tx_dropped[1] = midi_tx_dropped(MIDI_TX_SYSEX);
+  frame.events_dropped = getEventsDropped();
+  takeCpuHistogram(frame.cpu_histogram);
+  ProgramVector* pv = getProgramVector();
+  if(pv->parameters != NULL){
+    for(int i=0; i<TELEMETRY_PARAMETERS && i<pv->parameters_size; ++i)
+      frame.parameters[i] = pv->parameters[i];
+  }
+  buffer[0] = SYSEX_TELEMETRY;
+  size_t len = data_to_sysex((uint8_t*)&frame, buffer+1, sizeof(frame));
+  sendSysEx(buffer, len+1);
+}
+
 void MidiController::sendProgramStats(){
   char buffer[64];
   buffer[0] = SYSEX_PROGRAM_STATS;
@@ -274,13 +383,15 @@ void MidiController::sendPc(uint8_t pc){
   }
 }
 
-void MidiController::sendCc(uint8_t cc, uint8_t value){
+/* returns false if the message was not queued */
+bool MidiController::sendCc(uint8_t cc, uint8_t value){
   if(midi_device_connected()){
     uint8_t packet[4] = { USB_COMMAND_CONTROL_CHANGE,
 			  (uint8_t)(CONTROL_CHANGE | channel),
 			  cc, value };
-    midi_send_usb_buffer(packet, sizeof(packet));
+    return midi_send_usb_buffer(packet, sizeof(packet));
   }
+  return false;
 }
 
 void MidiController::sendNoteOff(uint8_t note, uint8_t velocity){
@@ -313,23 +424,27 @@ void MidiController::sendPitchBend(uint16_t value){
 /**
  * 
  */
-void MidiController::sendSysEx(uint8_t* data, uint16_t size){
+bool MidiController::sendSysEx(uint8_t* data, uint16_t size){
   /* USB-MIDI devices transmit sysex messages in 4-byte packets which
    * contain a status byte and up to 3 bytes of the message itself.
    * If the message ends with fewer than 3 bytes, a different code is
    * sent. Go through the sysex 3 bytes at a time, including the leading
    * 0xF0 and trailing 0xF7.
+   * Space for all the packets is reserved up front, so that the message is
+   * sent whole, or dropped if the transmit queue is too full.
+   * Returns false if it was dropped, or no device is connected.
    */
-  if(midi_device_connected()){
+  uint32_t pos;
+  if(midi_device_connected() && midi_tx_reserve(size/3+2, MIDI_TX_SYSEX, &pos)){
     uint8_t packet[4] = { USB_COMMAND_SYSEX, SYSEX, MIDI_SYSEX_MANUFACTURER, MIDI_SYSEX_DEVICE };
-    midi_send_usb_buffer(packet, sizeof(packet));
+    midi_tx_write(pos++, packet);
     int count = size/3;
     uint8_t* src = data;
     while(count-- > 0){
       packet[1] = (*src++ & 0x7f);
       packet[2] = (*src++ & 0x7f);
       packet[3] = (*src++ & 0x7f);
-      midi_send_usb_buffer(packet, sizeof(packet));
+      midi_tx_write(pos++, packet);
     }
     count = size % 3;
     switch(count){
@@ -352,7 +467,9 @@ void MidiController::sendSysEx(uint8_t* data, uint16_t size){
       packet[3] = SYSEX_EOX;
       break;
     }
-    midi_send_usb_buffer(packet, sizeof(packet));
+    midi_tx_write(pos, packet);
+    return true;
   }
+  return false;
 }
 
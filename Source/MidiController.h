@@ -11,25 +11,39 @@ extern MidiController midi;
 class MidiController {
 private:
   uint8_t channel;
+  /* outgoing parameter values, A-H and AA-BH, sent at most once per interval */
+  volatile uint32_t parameterChanged;
+  volatile uint8_t parameterValues[PARAMETER_BH+1];
+  uint8_t parameterSent[PARAMETER_BH+1];
+  uint16_t telemetryInterval;
 
 public:
   void init(uint8_t channel);
   void sendPc(uint8_t pc);
-  void sendCc(uint8_t cc, uint8_t value);
+  bool sendCc(uint8_t cc, uint8_t value);
   void sendPitchBend(uint16_t value);
   void sendNoteOn(uint8_t note, uint8_t velocity);
   void sendNoteOff(uint8_t note, uint8_t velocity);
 
-  void sendSysEx(uint8_t* data, uint16_t size);
+  bool sendSysEx(uint8_t* data, uint16_t size);
   void sendSettings();
   void sendConfigurationSetting(const char* name, uint32_t value);
   void sendPatchParameterNames();
   void sendPatchParameterName(PatchParameterId pid, const char* name);
   void sendPatchParameterValues();
+  void setParameterValue(uint8_t pid, int16_t value);
+  void sendParameterValues();
+  void setTelemetryInterval(uint16_t ms){
+    telemetryInterval = ms;
+  }
+  uint16_t getTelemetryInterval(){
+    return telemetryInterval;
+  }
   void sendPatchNames();
   void sendPatchName(uint8_t index);
   void sendDeviceInfo();
   void sendDeviceStats();
+  void sendTelemetry();
   void sendProgramStats();
   void sendFirmwareVersion();
   void sendDeviceId();
@@ -10,6 +10,12 @@
 #include "ApplicationSettings.h"
 #include "FirmwareLoader.hpp"
 #include "ProgramManager.h"
+#include "BackupStore.h"
+#include "ParameterAutomation.h"
+#include "i2s.h"
+#include "TempoTracker.h"
+#include "SignalMonitor.h"
+#include "clock.h"
 #include "Owl.h"
 
 class MidiHandler : public MidiReader {
@@ -30,6 +36,17 @@ public:
     memset(midi_values, 0, NOF_PARAMETERS*sizeof(uint16_t));
   }
 
+  void handleSystemCommon(uint8_t cmd){
+    switch(cmd){
+    case TIMING_CLOCK:
+      tempo.clock(getMicroseconds());
+      break;
+    case START:
+      tempo.start();
+      break;
+    }
+  }
+
   void handlePitchBend(uint8_t status, uint16_t value){
     // pitchbend = value;
     // setParameter(PARAMETER_G, value>>2);
@@ -176,6 +193,9 @@ public:
       case SYSEX_PROGRAM_STATS:
 	midi.sendProgramStats();
 	break;
+      case SYSEX_TELEMETRY:
+	program.sendTelemetryFromISR();
+	break;
       case PATCH_BUTTON:
 	midi.sendCc(PATCH_BUTTON, isPushButtonPressed() ? 127 : 0);
 	break;
@@ -218,6 +238,14 @@ public:
 	updateCodecSettings();
       }
       break;
+    case SAVE_PRESET:
+      if(!backup.savePreset(value))
+	setErrorMessage(PROGRAM_ERROR, "Invalid preset");
+      break;
+    case RECALL_PRESET:
+      if(!backup.recallPreset(value))
+	setErrorMessage(PROGRAM_ERROR, "Invalid preset");
+      break;
     case MIDI_CC_MODULATION:
       setParameter(PARAMETER_F, value<<5);
       break;
@@ -257,40 +285,104 @@ public:
     program.resetProgram(true);
   }
 
-  void handleConfigurationCommand(uint8_t* data, uint16_t size){
-    if(size < 4)
-      return;
-    char* p = (char*)data;
-    int32_t value = strtol(p+2, NULL, 16);
+  /* what has to be restarted for a configuration change to take effect */
+  enum ConfigurationChange {
+    CONFIGURATION_NONE = 0,
+    CONFIGURATION_PROGRAM,
+    CONFIGURATION_CODEC
+  };
+
+  template<typename T>
+  static ConfigurationChange changeSetting(T& setting, int32_t value, ConfigurationChange change){
+    if(setting == (T)value)
+      return CONFIGURATION_NONE;
+    setting = (T)value;
+    return change;
+  }
+
+  /* apply one setting, changes that only need a codec register write are made straight away */
+  ConfigurationChange applyConfiguration(const char* p, int32_t value){
     if(strncmp(SYSEX_CONFIGURATION_AUDIO_RATE, p, 2) == 0){
-      settings.audio_samplingrate = value;
+      return changeSetting(settings.audio_samplingrate, value, CONFIGURATION_CODEC);
     }else if(strncmp(SYSEX_CONFIGURATION_AUDIO_BLOCKSIZE, p, 2) == 0){
-      settings.audio_blocksize = value;
+      return changeSetting(settings.audio_blocksize, value, CONFIGURATION_CODEC);
     }else if(strncmp(SYSEX_CONFIGURATION_AUDIO_DATAFORMAT, p, 2) == 0){
-      settings.audio_dataformat = value;
+      return changeSetting(settings.audio_dataformat, value, CONFIGURATION_CODEC);
     }else if(strncmp(SYSEX_CONFIGURATION_CODEC_PROTOCOL, p, 2) == 0){
-      settings.audio_codec_protocol = (I2SProtocol)value;
+      return changeSetting(settings.audio_codec_protocol, value, CONFIGURATION_CODEC);
     }else if(strncmp(SYSEX_CONFIGURATION_CODEC_MASTER, p, 2) == 0){
-      settings.audio_codec_master = value;
+      return changeSetting(settings.audio_codec_master, value, CONFIGURATION_CODEC);
+    }else if(strncmp(SYSEX_CONFIGURATION_CODEC_HALFSPEED, p, 2) == 0){
+      // halves the sampling rate
+      return changeSetting(settings.audio_codec_halfspeed, value, CONFIGURATION_CODEC);
     }else if(strncmp(SYSEX_CONFIGURATION_CODEC_SWAP, p, 2) == 0){
-      settings.audio_codec_swaplr = value;
+      if(settings.audio_codec_swaplr != (bool)value){
+	settings.audio_codec_swaplr = value;
+	codec.setSwapLeftRight(value);
+      }
     }else if(strncmp(SYSEX_CONFIGURATION_CODEC_BYPASS, p, 2) == 0){
-      settings.audio_codec_bypass = value;
-    }else if(strncmp(SYSEX_CONFIGURATION_CODEC_HALFSPEED, p, 2) == 0){
-      settings.audio_codec_halfspeed = value;
-      // settings.audio_codec_halfspeed = (p[2] == '1' ? true : false);
+      if(settings.audio_codec_bypass != (bool)value){
+	settings.audio_codec_bypass = value;
+	codec.setBypass(value);
+      }
+    }else if(strncmp(SYSEX_CONFIGURATION_CODEC_INPUT_GAIN, p, 2) == 0){
+      settings.inputGainLeft = value;
+      settings.inputGainRight = value;
+      codec.setInputGainLeft(value);
+      codec.setInputGainRight(value);
+    }else if(strncmp(SYSEX_CONFIGURATION_CODEC_OUTPUT_GAIN, p, 2) == 0){
+      settings.outputGainLeft = value;
+      settings.outputGainRight = value;
+      codec.setOutputGainLeft(value);
+      codec.setOutputGainRight(value);
     }else if(strncmp(SYSEX_CONFIGURATION_PC_BUTTON, p, 2) == 0){
       settings.program_change_button = value;
+    }else if(strncmp(SYSEX_CONFIGURATION_MIDI_INTERVAL, p, 2) == 0){
+      settings.midi_parameter_interval = value;
+    }else if(strncmp(SYSEX_CONFIGURATION_TELEMETRY_INTERVAL, p, 2) == 0){
+      midi.setTelemetryInterval(value);
+    }else if(strncmp(SYSEX_CONFIGURATION_MONITOR_MODE, p, 2) == 0){
+      monitor.setMode(value);
+    }else if(strncmp(SYSEX_CONFIGURATION_MONITOR_CHANNEL, p, 2) == 0){
+      monitor.setChannel(value);
+    }else if(strncmp(SYSEX_CONFIGURATION_MONITOR_DECIMATION, p, 2) == 0){
+      monitor.setDecimation(value);
+    }else if(strncmp(SYSEX_CONFIGURATION_MONITOR_INTERVAL, p, 2) == 0){
+      monitor.setInterval(value);
     }else if(strncmp(SYSEX_CONFIGURATION_INPUT_OFFSET, p, 2) == 0){
-      settings.input_offset = value;
+      // calibration is read by the program when it starts
+      return changeSetting(settings.input_offset, value, CONFIGURATION_PROGRAM);
     }else if(strncmp(SYSEX_CONFIGURATION_INPUT_SCALAR, p, 2) == 0){
-      settings.input_scalar = value;
+      return changeSetting(settings.input_scalar, value, CONFIGURATION_PROGRAM);
     }else if(strncmp(SYSEX_CONFIGURATION_OUTPUT_OFFSET, p, 2) == 0){
-      settings.output_offset = value;
+      return changeSetting(settings.output_offset, value, CONFIGURATION_PROGRAM);
     }else if(strncmp(SYSEX_CONFIGURATION_OUTPUT_SCALAR, p, 2) == 0){
-      settings.output_scalar = value;
+      return changeSetting(settings.output_scalar, value, CONFIGURATION_PROGRAM);
+    }
+    return CONFIGURATION_NONE;
+  }
+
+  /*
+   * One or more settings, separated by commas, e.g. "FSbb80,BS80".
+   * All settings are applied first, then audio or the program is
+   * restarted at most once, and only if a setting needs it.
+   */
+  void handleConfigurationCommand(uint8_t* data, uint16_t size){
+    char* p = (char*)data;
+    char* end = p+size;
+    ConfigurationChange change = CONFIGURATION_NONE;
+    while(end-p >= 3){
+      char* next;
+      int32_t value = strtol(p+2, &next, 16);
+      change = max(change, applyConfiguration(p, value));
+      if(next >= end || *next != ',')
+	break;
+      p = next+1;
     }
-    updateCodecSettings();
+    if(change == CONFIGURATION_CODEC)
+      updateCodecSettings();
+    else if(change == CONFIGURATION_PROGRAM)
+      program.resetProgram(true);
   }
 
   void handleFirmwareUploadCommand(uint8_t* data, uint16_t size){
@@ -341,6 +433,31 @@ public:
     }
   }
 
+  /*
+   * points of 7 bytes: parameter id, 14-bit value msb first,
+   * and 28-bit time in samples on the host's clock, msb first
+   */
+  void handleParameterAutomationCommand(uint8_t* data, uint16_t size){
+    uint32_t now = getSampleClock();
+    for(int i=0; i+7<=size; i+=7){
+      uint16_t value = (data[i+1]<<7) | data[i+2];
+      uint32_t time = (data[i+3]<<21) | (data[i+4]<<14) | (data[i+5]<<7) | data[i+6];
+      automation.add(data[i], value, time, now);
+    }
+  }
+
+  void handleFirmwareSendCommand(uint8_t* data, uint16_t size){
+    if(size == 5){
+      uint32_t slot = loader.decodeInt(data);
+      if(slot < MAX_USER_PATCHES || slot == 0xff)
+	program.sendProgramFromFlash(slot);
+      else
+	setErrorMessage(PROGRAM_ERROR, "Invalid program slot");
+    }else{
+      setErrorMessage(PROGRAM_ERROR, "Invalid SEND command");
+    }
+  }
+
   void handleSysEx(uint8_t* data, uint16_t size){
     if(size < 3 || 
        data[0] != MIDI_SYSEX_MANUFACTURER || 
@@ -350,6 +467,9 @@ public:
     case SYSEX_CONFIGURATION_COMMAND:
       handleConfigurationCommand(data+3, size-3);
       break;
+    case SYSEX_PARAMETER_AUTOMATION:
+      handleParameterAutomationCommand(data+3, size-3);
+      break;
     case SYSEX_DFU_COMMAND:
       jump_to_bootloader();
       break;
@@ -365,6 +485,9 @@ public:
     case SYSEX_FIRMWARE_FLASH:
       handleFirmwareFlashCommand(data+3, size-3);
       break;
+    case SYSEX_FIRMWARE_SEND:
+      handleFirmwareSendCommand(data+3, size-3);
+      break;
     }
   }
 };
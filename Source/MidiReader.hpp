@@ -48,6 +48,90 @@ public:
     return message;
   }
 
+  /* decode a buffer of 4-byte USB-MIDI packets, as received in one transfer */
+  void readPackets(const uint8_t* data, uint16_t length){
+    for(uint16_t i=0; i+4<=length; i+=4){
+      if(readPacket(data+i) == ERROR_STATUS)
+	clear(); // discard the message, the next packet stands on its own
+    }
+  }
+
+  /*
+   * Decode one USB-MIDI packet by its Code Index Number. Channel messages
+   * are always complete in one packet and are handled straight away,
+   * without touching a sysex message in progress.
+   */
+  MidiReaderStatus readPacket(const uint8_t* packet){
+    switch(packet[0] & 0x0f){
+    case USB_COMMAND_SYSEX:
+      return readSysEx(packet+1, 3, false);
+    case USB_COMMAND_SYSEX_EOX1:
+      if(packet[1] == SYSEX_EOX)
+	return readSysEx(packet+1, 1, true);
+      handleSystemCommon(packet[1]); // single byte system common, e.g. tune request
+      break;
+    case USB_COMMAND_SYSEX_EOX2:
+      return readSysEx(packet+1, 2, true);
+    case USB_COMMAND_SYSEX_EOX3:
+      return readSysEx(packet+1, 3, true);
+    case USB_COMMAND_NOTE_OFF:
+      handleNoteOff(packet[1], packet[2], packet[3]);
+      break;
+    case USB_COMMAND_NOTE_ON:
+      if(packet[3] == 0)
+	handleNoteOff(packet[1], packet[2], packet[3]);
+      else
+	handleNoteOn(packet[1], packet[2], packet[3]);
+      break;
+    case USB_COMMAND_POLY_KEY_PRESSURE:
+      handlePolyKeyPressure(packet[1], packet[2], packet[3]);
+      break;
+    case USB_COMMAND_CONTROL_CHANGE:
+      handleControlChange(packet[1], packet[2], packet[3]);
+      break;
+    case USB_COMMAND_PROGRAM_CHANGE:
+      handleProgramChange(packet[1], packet[2]);
+      break;
+    case USB_COMMAND_CHANNEL_PRESSURE:
+      handleChannelPressure(packet[1], packet[2]);
+      break;
+    case USB_COMMAND_PITCH_BEND_CHANGE:
+      handlePitchBend(packet[1], (packet[3]<<7) | packet[2]);
+      break;
+    case USB_COMMAND_2BYTE_SYSTEM_COMMON:
+    case USB_COMMAND_3BYTE_SYSTEM_COMMON:
+      handleSystemCommon(packet[1]);
+      break;
+    case USB_COMMAND_SINGLE_BYTE:
+      if(packet[1] >= STATUS_BYTE)
+	handleSystemCommon(packet[1]); // real time messages may come in the middle of a sysex
+      break;
+    default:
+      // reserved for future extensions
+      break;
+    }
+    return READY_STATUS;
+  }
+
+  /* append the sysex bytes of one packet, and handle the message when it ends */
+  MidiReaderStatus readSysEx(const uint8_t* data, int len, bool end){
+    if(data[0] == SYSEX)
+      pos = 0;
+    else if(status != INCOMPLETE_STATUS || message[0] != SYSEX)
+      return status = ERROR_STATUS; // continued without a start
+    if(pos+len > size)
+      return status = ERROR_STATUS;
+    for(int i=0; i<len; ++i)
+      message[pos++] = data[i];
+    if(end){
+      status = READY_STATUS;
+      handleSysEx(message+1, pos-2);
+    }else{
+      status = INCOMPLETE_STATUS;
+    }
+    return status;
+  }
+
   MidiReaderStatus read(unsigned char data){
     if(status == READY_STATUS){
       clear(); // discard previous message
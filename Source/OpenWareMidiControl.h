@@ -68,8 +68,16 @@ enum PatchButtonId {
 #define SYSEX_CONFIGURATION_CODEC_MASTER          "MS"
 #define SYSEX_CONFIGURATION_CODEC_SWAP            "SW"
 #define SYSEX_CONFIGURATION_CODEC_BYPASS          "BY"
+#define SYSEX_CONFIGURATION_CODEC_INPUT_GAIN      "IG" /* both channels, 0 to 31 (23 = 0dB) */
+#define SYSEX_CONFIGURATION_CODEC_OUTPUT_GAIN     "OG" /* both channels, 0 to 127 (121 = 0dB) */
 #define SYSEX_CONFIGURATION_CODEC_HALFSPEED       "HS"
 #define SYSEX_CONFIGURATION_PC_BUTTON             "PC"
+#define SYSEX_CONFIGURATION_MIDI_INTERVAL         "MI"
+#define SYSEX_CONFIGURATION_TELEMETRY_INTERVAL    "TI"
+#define SYSEX_CONFIGURATION_MONITOR_MODE          "SM"
+#define SYSEX_CONFIGURATION_MONITOR_CHANNEL       "SC"
+#define SYSEX_CONFIGURATION_MONITOR_DECIMATION    "SD"
+#define SYSEX_CONFIGURATION_MONITOR_INTERVAL      "SI"
 #define SYSEX_CONFIGURATION_INPUT_OFFSET          "IO"
 #define SYSEX_CONFIGURATION_INPUT_SCALAR          "IS"
 #define SYSEX_CONFIGURATION_OUTPUT_OFFSET         "OO"
@@ -79,16 +87,20 @@ enum OpenWareMidiSysexCommand {
   SYSEX_PRESET_NAME_COMMAND       = 0x01,
   SYSEX_PARAMETER_NAME_COMMAND    = 0x02,
   SYSEX_CONFIGURATION_COMMAND     = 0x03,
+  SYSEX_PARAMETER_AUTOMATION      = 0x04,
   SYSEX_DFU_COMMAND               = 0x7e,
   SYSEX_FIRMWARE_UPLOAD           = 0x10,
   SYSEX_FIRMWARE_STORE            = 0x11,
   SYSEX_FIRMWARE_RUN              = 0x12,
   SYSEX_FIRMWARE_FLASH            = 0x13,
+  SYSEX_FIRMWARE_SEND             = 0x14,
   SYSEX_FIRMWARE_VERSION          = 0x20,
   SYSEX_DEVICE_ID                 = 0x21,
   SYSEX_PROGRAM_MESSAGE           = 0x22,
   SYSEX_DEVICE_STATS              = 0x23,
-  SYSEX_PROGRAM_STATS             = 0x24
+  SYSEX_PROGRAM_STATS             = 0x24,
+  SYSEX_TELEMETRY                 = 0x25,
+  SYSEX_MONITOR                   = 0x26
 };
 
 /*
@@ -124,6 +136,8 @@ enum OpenWareMidiControl {
   SAVE_SETTINGS          = 68, /* save settings to device */
   FACTORY_RESET          = 70, /* reset all settings */
   DEVICE_STATUS          = 71,
+  SAVE_PRESET            = 72, /* save program and parameters to preset 0-7 in backup SRAM */
+  RECALL_PRESET          = 73, /* recall preset 0-7 from backup SRAM */
 
   PATCH_PARAMETER_AA     = 75,
   PATCH_PARAMETER_AB     = 76,
@@ -1,9 +1,18 @@
 #include <string.h>
 #include "Owl.h"
 #include "armcontrol.h"
+#include "i2s.h"
 #include "usbcontrol.h"
 #include "owlcontrol.h"
 #include "PatchRegistry.h"
+#include "PatchStore.h"
+#include "InternalFlash.h"
+#include "BackupStore.h"
+#include "Telemetry.h"
+#include "ParameterAutomation.h"
+#include "TempoTracker.h"
+#include "DeferredLog.h"
+#include "SignalMonitor.h"
 #include "MidiController.h"
 #include "CodecController.h"
 #include "ApplicationSettings.h"
@@ -18,7 +27,7 @@
 #include "clock.h"
 #include "device.h"
 #include "codec.h"
-#include "BitState.hpp"
+#include "AudioEventQueue.hpp"
 
 #define DEBOUNCE(nm, ms) if(true){static uint32_t nm ## Debounce = 0; \
 if(getSysTicks() < nm ## Debounce+(ms)) return; nm ## Debounce = getSysTicks();}
@@ -27,10 +36,27 @@ CodecController codec;
 MidiController midi;
 ApplicationSettings settings;
 PatchRegistry registry;
-
-// there are only really 2 timestamps needed: LED pushbutton and midi gate
-uint16_t timestamps[NOF_BUTTONS]; 
-BitState32 stateChanged;
+InternalFlash internalFlash;
+PatchStore storage(internalFlash, ADDR_FLASH_SECTOR_8);
+BackupStore backup;
+ParameterAutomation automation;
+TempoTracker tempo;
+DeferredLog debugLog;
+SignalMonitor monitor;
+
+// button and note changes, delivered to the program at the start of each block
+static AudioEventQueue events;
+
+/*
+ * Parameter changes are coalesced instead of queued: only the latest value
+ * of each parameter, and the sample clock when it was set, is kept until
+ * the start of the next block. A flood of changes can then neither lose
+ * the last value nor fill the queue that button and note events need.
+ */
+#define PARAMETER_CHANGE_WORDS ((NOF_PARAMETERS+31)/32)
+static volatile int16_t parameterChangeValues[NOF_PARAMETERS];
+static volatile uint32_t parameterChangeTimes[NOF_PARAMETERS];
+static volatile uint32_t parameterChanges[PARAMETER_CHANGE_WORDS];
 
 bool getButton(PatchButtonId bid){
   return getProgramVector()->buttons & (1<<bid);
@@ -78,15 +104,15 @@ static void setButtonColour(LedPin led){
 
 // called from incoming button trigger irq
 static void setButtonEvent(PatchButtonId bid){
-  timestamps[bid] = getSampleCounter();
-  stateChanged.set(bid);
   setButtonState(bid);
+  if(bid != BYPASS_BUTTON) // not passed on to the program
+    events.push(AUDIO_EVENT_BUTTON, bid, 4095, getSampleClock());
 }
 
 static void clearButtonEvent(PatchButtonId bid){
-  timestamps[bid] = getSampleCounter();
-  stateChanged.set(bid);
   clearButtonState(bid);
+  if(bid != BYPASS_BUTTON)
+    events.push(AUDIO_EVENT_BUTTON, bid, 0, getSampleClock());
 }
 
 static void updateBypassMode(){
@@ -140,6 +166,7 @@ static void pushButtonCallback(){
   if(isPushButtonPressed()){
     if(!getButton(PUSHBUTTON)){
       pushButtonPressed = getSysTicks();
+      tempo.tap(getMicroseconds());
       setButtonEvent(PUSHBUTTON);
       setGate();
       setButtonColour(RED);
@@ -168,6 +195,7 @@ void exitProgram(bool isr){
 void updateProgramIndex(uint8_t index){
   if(settings.program_index != index){
     settings.program_index = index;
+    backup.setProgramIndex(index);
     midi.sendPc(index);
     midi.sendPatchName(index);
   }
@@ -202,34 +230,50 @@ void updateProgramIndex(uint8_t index){
 
 #define DWT_CYCCNT ((volatile unsigned int *)0xE0001004)
 extern volatile ProgramVectorAudioStatus audioStatus;
+static volatile uint32_t audioOverruns = 0;
+static volatile uint16_t cpuHistogram[TELEMETRY_HISTOGRAM_BINS];
 
    __attribute__ ((section (".coderam")))
    // called from program
    void onProgramReady(){
-     // program.programReady();
      ProgramVector* vec = getProgramVector();
+     // the block just processed stays in place until the next one is ready
+     monitor.process(vec->audio_input, vec->audio_output, vec->audio_blocksize);
+     // counts the cycles of the block and waits for the next one
+     program.programReady();
 #ifdef DEBUG_DWT
-     vec->cycles_per_block = *DWT_CYCCNT;
-#endif /* DEBUG_DWT */
-#ifdef DEBUG_AUDIO
-     clearPin(GPIOC, GPIO_Pin_5); // PC5 DEBUG
-#endif
-     while(audioStatus != AUDIO_READY_STATUS);
-     audioStatus = AUDIO_PROCESSING_STATUS;
-#ifdef DEBUG_DWT
-     *DWT_CYCCNT = 0; // reset the performance counter
+     uint32_t bin = vec->cycles_per_block*TELEMETRY_HISTOGRAM_BINS/(vec->audio_blocksize*ARM_CYCLES_PER_SAMPLE);
+     cpuHistogram[min(bin, TELEMETRY_HISTOGRAM_BINS-1)]++;
 #endif /* DEBUG_DWT */
-#ifdef DEBUG_AUDIO
-     setPin(GPIOC, GPIO_Pin_5); // PC5 DEBUG
-#endif
-     if(vec->buttonChangedCallback != NULL && stateChanged.getState()){
-       int bid = stateChanged.getFirstSetIndex();
-       do{
-	 vec->buttonChangedCallback(bid, getButton((PatchButtonId)bid)?4095:0, timestamps[bid]);
-	 timestamps[bid] = 0;
- 	 stateChanged.clear(bid);
-	 bid = stateChanged.getFirstSetIndex();
-       }while(bid > 0); // bid 0 is bypass button which we ignore
+     uint32_t start = getBlockSampleClock();
+     automation.process(vec->parameters, vec->parameters_size, vec->audio_blocksize, start);
+     // events in the order they happened, with offsets into the block
+     // about to be processed. Events that arrived after it completed are
+     // left for the next block, stale ones are moved to its first sample.
+     int32_t blocksize = vec->audio_blocksize;
+     AudioEvent* event;
+     while((event = events.front()) != NULL){
+       int32_t offset = event->time - start;
+       if(offset >= blocksize && offset < 2*blocksize)
+	 break;
+       offset = max(0, min(offset, blocksize-1));
+       if(vec->buttonChangedCallback != NULL)
+	 vec->buttonChangedCallback(event->id, event->value, offset);
+       events.pop();
+     }
+     // the latest value of each changed parameter, unless it was set after the block completed
+     for(int i=0; i<PARAMETER_CHANGE_WORDS; ++i){
+       uint32_t changes = __sync_fetch_and_and(&parameterChanges[i], 0);
+       while(changes){
+	 uint8_t pid = i*32 + __builtin_ctz(changes);
+	 uint32_t bit = changes & -changes;
+	 changes &= changes-1;
+	 int32_t offset = parameterChangeTimes[pid] - start;
+	 if(offset >= blocksize && offset < 2*blocksize)
+	   __sync_fetch_and_or(&parameterChanges[i], bit);
+	 else if(pid < vec->parameters_size)
+	   vec->parameters[pid] = parameterChangeValues[pid];
+       }
      }
    }
 
@@ -278,28 +322,8 @@ extern volatile ProgramVectorAudioStatus audioStatus;
    void onSetPatchParameter(uint8_t pid, int16_t value){     
      if(pid < NOF_PARAMETERS)
        getProgramVector()->parameters[pid] = value;
-     switch(pid){
-     case PARAMETER_A:
-     case PARAMETER_B:
-     case PARAMETER_C:
-     case PARAMETER_D:
-     case PARAMETER_E:
-       midi.sendCc(PATCH_PARAMETER_A+pid, (value>>5) & 0x7f);
-       break;
-     case PARAMETER_F:
-       midi.sendCc(PATCH_PARAMETER_F, (value>>5) & 0x7f);
-       break;
-     case PARAMETER_G:
-       midi.sendCc(PATCH_PARAMETER_G, (value>>5) & 0x7f);
-       // midi.sendPitchBend(value<<1);
-       break;
-     case PARAMETER_H:
-       midi.sendCc(PATCH_PARAMETER_H, (value>>5) & 0x7f);
-       break;
-     default:
-       if(pid >= PARAMETER_AA && pid <= PARAMETER_BH)
-	 midi.sendCc(PATCH_PARAMETER_AA+(pid-PARAMETER_AA), (value>>5) & 0x7f);	 
-     }
+     // sent as a CC on the next USB frame interval
+     midi.setParameterValue(pid, value);
    }
 
    // called from midi irq
@@ -310,15 +334,19 @@ extern volatile ProgramVectorAudioStatus audioStatus;
        else
 	 clearButtonEvent((PatchButtonId)bid);
      }else if(bid >= MIDI_NOTE_BUTTON){
-       if(getProgramVector()->buttonChangedCallback != NULL)
-	 getProgramVector()->buttonChangedCallback(bid, state, getSampleCounter());
+       events.push(AUDIO_EVENT_BUTTON, bid, state, getSampleClock());
      }
    }
 
    // called from midi irq
    void setParameter(uint8_t pid, int16_t value){
      ASSERT(pid < getProgramVector()->parameters_size, "Parameter ID out of range");
-     getProgramVector()->parameters[pid] = value;
+     if(pid >= NOF_PARAMETERS)
+       return;
+     // applied at the start of the next block, the value set last wins
+     parameterChangeValues[pid] = value;
+     parameterChangeTimes[pid] = getSampleClock();
+     __sync_fetch_and_or(&parameterChanges[pid/32], 1u<<(pid%32)); // after the value
    }
 
    int16_t getParameterValue(uint8_t pid){
@@ -326,6 +354,22 @@ extern volatile ProgramVectorAudioStatus audioStatus;
      return getProgramVector()->parameters[pid];
    }
 
+   uint32_t getAudioOverruns(){
+     return audioOverruns;
+   }
+
+   uint32_t getEventsDropped(){
+     return events.getDropped();
+   }
+
+   /* copy and clear the counts of blocks by cpu load */
+   void takeCpuHistogram(uint16_t* bins){
+     for(int i=0; i<TELEMETRY_HISTOGRAM_BINS; ++i){
+       bins[i] = cpuHistogram[i];
+       cpuHistogram[i] = 0;
+     }
+   }
+
 #ifdef __cplusplus
 }
 #endif
@@ -362,6 +406,7 @@ void updateProgramVector(ProgramVector* vector){
   vector->setButton = onSetButton;
   vector->setPatchParameter = onSetPatchParameter;
   vector->buttonChangedCallback = NULL;
+  events.flush(); // no button or note events are passed on from the previous program
   extern char _EXTRAM, _EXTRAM_END;
   extern char _CCMRAM, _CCMRAM_END;
   static MemorySegment heapSegments[] = {
@@ -410,9 +455,12 @@ void setup(){
 #endif
   setupSwitchB(pushButtonCallback);
 
-  settings.init();
+  settings.init(internalFlash, ADDR_FLASH_SECTOR_1);
   midi.init(MIDI_CHANNEL);
+  storage.init();
   registry.init();
+  if(backup.init())
+    settings.program_index = backup.getProgramIndex();
 
 #ifdef EXPRESSION_PEDAL
 #ifndef OWLMODULAR
@@ -456,6 +504,7 @@ void setup(){
   codec.softMute(true);
 
   program.loadProgram(settings.program_index);
+  backup.restoreState();
   program.startProgram(false);
 
   updateBypassMode();
@@ -479,8 +528,11 @@ void audioCallback(int16_t *src, int16_t *dst){
 #endif
   getProgramVector()->audio_input = (int32_t*)src;
   getProgramVector()->audio_output = (int32_t*)dst;
-  // program.audioReady();
-  audioStatus = AUDIO_READY_STATUS;
+  if(audioStatus == AUDIO_READY_STATUS){
+    audioOverruns++; // the previous block was never picked up
+    debugLog.log("Audio overrun %u", audioOverruns);
+  }
+  program.audioReady();
 
 #ifdef BUTTON_PROGRAM_CHANGE
   if(pushButtonPressed && (getSysTicks() > pushButtonPressed+PROGRAM_CHANGE_PUSHBUTTON_MS)
@@ -25,6 +25,9 @@
    void setButton(uint8_t bid, uint16_t state);
    void setParameter(uint8_t pid, int16_t value);
    int16_t getParameterValue(uint8_t index);
+   uint32_t getAudioOverruns();
+   uint32_t getEventsDropped();
+   void takeCpuHistogram(uint16_t* bins);
    void setup(); // main OWL setup
 
 #ifdef __cplusplus
@@ -0,0 +1,125 @@
+#include <string.h>
+#include "ParameterAutomation.h"
+
+#define POINT_MASK (PARAMETER_AUTOMATION_POINTS-1)
+
+ParameterAutomation::ParameterAutomation()
+  : synced(false), hostTime(0), hostClock(0), offset(0), dropped(0), resyncs(0),
+    blockStart(0) {
+  memset(tracks, 0, sizeof(tracks));
+}
+
+/*
+ * called from the MIDI interrupt, with the 28-bit host time of the point
+ * and the audio sample clock on arrival
+ */
+bool ParameterAutomation::add(uint8_t pid, uint16_t value, uint32_t time, uint32_t now){
+  if(pid >= NOF_PARAMETERS)
+    return false;
+  time &= PARAMETER_AUTOMATION_TIME_MASK;
+  if(!synced){
+    hostClock = time;
+    offset = now + PARAMETER_AUTOMATION_LATENCY - time;
+    synced = true;
+  }else{
+    // extend the host time to 32 bits, it may go back a little between parameters
+    int32_t delta = (int32_t)((time - hostTime) << 4) >> 4;
+    hostClock += delta;
+  }
+  hostTime = time;
+  uint32_t at = hostClock + offset;
+  int32_t ahead = at - now;
+  if(ahead < 0 || ahead > 2*PARAMETER_AUTOMATION_LATENCY){
+    offset += now + PARAMETER_AUTOMATION_LATENCY - at;
+    at = now + PARAMETER_AUTOMATION_LATENCY;
+    resyncs++;
+  }
+  Track& track = tracks[pid];
+  if(track.head - track.tail >= PARAMETER_AUTOMATION_POINTS){
+    dropped++;
+    return false;
+  }
+  if(track.head != track.tail && (int32_t)(at - track.last) < 0)
+    at = track.last; // keep the points of a parameter in order after a resync
+  ParameterAutomationPoint& point = track.points[track.head & POINT_MASK];
+  point.time = at;
+  point.value = value;
+  track.last = at;
+  __sync_synchronize(); // the point must be written before the consumer can see it
+  track.head++;
+  return true;
+}
+
+/* value of the curve at a time not before the start of the current segment */
+float ParameterAutomation::valueAt(Track& track, uint32_t time, uint32_t head){
+  ParameterAutomationPoint* from = &track.from;
+  uint32_t i = track.tail;
+  while(i != head && (int32_t)(track.points[i & POINT_MASK].time - time) <= 0)
+    from = &track.points[i++ & POINT_MASK];
+  if(i == head)
+    return from->value;
+  ParameterAutomationPoint* to = &track.points[i & POINT_MASK];
+  int32_t span = to->time - from->time;
+  int32_t pos = time - from->time;
+  return from->value + (to->value - from->value)*((float)pos/span);
+}
+
+/*
+ * called from the audio task at the start of each block, with the sample
+ * clock of its first sample
+ */
+__attribute__ ((section (".coderam")))
+void ParameterAutomation::process(int16_t* parameters, int size, uint16_t blocksize, uint32_t start){
+  blockStart = start;
+  for(int pid=0; pid<NOF_PARAMETERS; ++pid){
+    Track& track = tracks[pid];
+    uint32_t head = track.head;
+    if(head == track.tail)
+      continue;
+    if(parameters == NULL || pid >= size){
+      // not a parameter of this program: discard its points
+      track.tail = head;
+      track.running = false;
+      continue;
+    }
+    __sync_synchronize(); // read the points after the head
+    if(!track.running){
+      // start from the parameter as it is now, unless that is where the last curve ended
+      if(parameters[pid] != track.from.value>>2){
+	track.from.value = parameters[pid]<<2;
+	track.from.time = start;
+      }
+      track.running = true;
+    }
+    while(track.tail != head && (int32_t)(track.points[track.tail & POINT_MASK].time - start) <= 0){
+      track.from = track.points[track.tail & POINT_MASK];
+      track.tail++;
+    }
+    parameters[pid] = (int16_t)valueAt(track, start+blocksize-1, head)>>2;
+    if(track.tail == head)
+      track.running = false; // the last point has been reached
+  }
+}
+
+/*
+ * Fill a buffer with the value of a parameter for each sample of the
+ * current block, scaled to [0, 1). Called from the audio task, after
+ * process(). A parameter without a curve in progress holds its current value.
+ */
+void ParameterAutomation::getSamples(uint8_t pid, float* buffer, int size, int16_t current){
+  const float scale = 1.0f/16384;
+  if(pid >= NOF_PARAMETERS)
+    return;
+  Track& track = tracks[pid];
+  if(!track.running){
+    // keep the full resolution of the last point, unless the parameter has been changed since
+    float value = current == track.from.value>>2 ? track.from.value : current<<2;
+    for(int i=0; i<size; ++i)
+      buffer[i] = value*scale;
+    return;
+  }
+  uint32_t head = track.head;
+  __sync_synchronize();
+  for(int i=0; i<size; ++i)
+    buffer[i] = valueAt(track, blockStart+i, head)*scale;
+}
@@ -0,0 +1,65 @@
+#ifndef __ParameterAutomation_h__
+#define __ParameterAutomation_h__
+
+#include <stdint.h>
+#include "device.h"
+
+#define PARAMETER_AUTOMATION_POINTS   16  /* per parameter, a power of two */
+#define PARAMETER_AUTOMATION_LATENCY  384 /* samples from arrival to playback */
+#define PARAMETER_AUTOMATION_TIME_MASK 0x0fffffff /* 28-bit host time */
+
+struct ParameterAutomationPoint {
+  uint32_t time;  // sample clock
+  uint16_t value; // 14 bits
+};
+
+/*
+ * Parameter changes streamed over sysex, as points on a piecewise linear
+ * curve. Each point has a time on the host's sample clock, which is
+ * mapped to the audio sample clock with a fixed latency, so that the
+ * curve does not depend on when the USB packets arrive.
+ * The MIDI interrupt adds points to a single producer, single consumer
+ * ring per parameter. At the start of each block the audio task drops
+ * the points that have passed and sets the parameter to the value the
+ * curve has at the end of the block; a program can also get the value
+ * for every sample of the block.
+ * If a point arrives too late, or too early, the mapping is moved to put
+ * it the latency ahead of the audio clock again.
+ */
+class ParameterAutomation {
+private:
+  struct Track {
+    ParameterAutomationPoint points[PARAMETER_AUTOMATION_POINTS];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    uint32_t last; // time of the last point added
+    ParameterAutomationPoint from; // start of the current segment
+    bool running;
+  };
+  Track tracks[NOF_PARAMETERS];
+  // written by the producer only
+  bool synced;
+  uint32_t hostTime;
+  uint32_t hostClock;
+  uint32_t offset;
+  uint32_t dropped;
+  uint32_t resyncs;
+  // written by the consumer only
+  uint32_t blockStart;
+  float valueAt(Track& track, uint32_t time, uint32_t head);
+public:
+  ParameterAutomation();
+  bool add(uint8_t pid, uint16_t value, uint32_t time, uint32_t now);
+  void process(int16_t* parameters, int size, uint16_t blocksize, uint32_t start);
+  void getSamples(uint8_t pid, float* buffer, int size, int16_t current);
+  uint32_t getDropped(){
+    return dropped;
+  }
+  uint32_t getResyncs(){
+    return resyncs;
+  }
+};
+
+extern ParameterAutomation automation;
+
+#endif // __ParameterAutomation_h__
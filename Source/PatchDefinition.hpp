@@ -33,6 +33,9 @@ public:
   const char* getName(){
     return name;
   }
+  virtual const char* getParameterName(uint8_t pid){
+    return NULL;
+  }
   ProgramVector* getProgramVector(){
     return programVector;
   }
@@ -0,0 +1,322 @@
+#include <stddef.h>
+#include "PatchStore.h"
+#include "ProgramVector.h"
+#include "ProgramHeader.h"
+#include "crc32.h"
+
+#define PATCH_STORE_ERASED_WORD      ((uint32_t)0xffffffff)
+/* size of a record header plus word aligned patch data */
+#define PATCH_STORE_RECORD_SIZE(sz)  (sizeof(PatchStoreRecord)+(((sz)+3) & ~3))
+
+PatchStore::PatchStore(FlashBackend& backend, uint32_t address)
+  : flash(backend), base(address), sequence(0) {}
+
+uint32_t PatchStore::getSectorAddress(int sector){
+  return base + sector*PATCH_STORE_SECTOR_SIZE;
+}
+
+int PatchStore::getSectorIndex(void* address){
+  return ((uintptr_t)address - base)/PATCH_STORE_SECTOR_SIZE;
+}
+
+bool PatchStore::isErased(uint32_t address, uint32_t size){
+  uint32_t* p = (uint32_t*)address;
+  for(uint32_t i=0; i<size; i+=4)
+    if(*p++ != PATCH_STORE_ERASED_WORD)
+      return false;
+  return true;
+}
+
+int PatchStore::getErasedSectorCount(){
+  int count = 0;
+  for(int i=0; i<PATCH_STORE_SECTORS; ++i)
+    if(state[i] == SECTOR_ERASED)
+      count++;
+  return count;
+}
+
+int PatchStore::getErasedSector(){
+  for(int i=0; i<PATCH_STORE_SECTORS; ++i)
+    if(state[i] == SECTOR_ERASED)
+      return i;
+  return -1;
+}
+
+/* flash must be unlocked */
+int PatchStore::eraseSector(int sector){
+  int ret = flash.erase(getSectorAddress(sector));
+  state[sector] = SECTOR_ERASED;
+  used[sector] = 0;
+  garbage[sector] = 0;
+  return ret;
+}
+
+void PatchStore::clearSlot(uint8_t slot){
+  records[slot] = NULL;
+  patches[slot] = NULL;
+  sizes[slot] = 0;
+}
+
+void PatchStore::addRecord(PatchStoreRecord* record){
+  uint8_t slot = record->slot;
+  PatchStoreRecord* previous = records[slot];
+  if(previous != NULL && previous->sequence >= record->sequence){
+    // an older copy, left behind by an interrupted write or collection
+    garbage[getSectorIndex(record)] += PATCH_STORE_RECORD_SIZE(record->size);
+    return;
+  }
+  if(previous != NULL)
+    garbage[getSectorIndex(previous)] += PATCH_STORE_RECORD_SIZE(previous->size);
+  else if(patches[slot] != NULL) // supersedes a patch in a legacy sector
+    garbage[getSectorIndex(patches[slot])] = PATCH_STORE_SECTOR_SIZE;
+  records[slot] = record;
+  patches[slot] = (uint8_t*)record + sizeof(PatchStoreRecord);
+  sizes[slot] = record->size;
+  if(record->sequence >= sequence)
+    sequence = record->sequence+1;
+}
+
+void PatchStore::scanSector(int sector){
+  uint32_t address = getSectorAddress(sector);
+  uint32_t magic = *(uint32_t*)address;
+  used[sector] = 0;
+  garbage[sector] = 0;
+  if(magic == PATCH_STORE_SECTOR_MAGIC){
+    state[sector] = SECTOR_LOG;
+    uint32_t offset = sizeof(magic);
+    while(offset+sizeof(PatchStoreRecord) <= PATCH_STORE_SECTOR_SIZE){
+      PatchStoreRecord* record = (PatchStoreRecord*)(address+offset);
+      if(record->size == PATCH_STORE_ERASED_WORD)
+	break; // end of log
+      uint32_t length = PATCH_STORE_RECORD_SIZE(record->size);
+      if(record->size > PATCH_STORE_SECTOR_SIZE || offset+length > PATCH_STORE_SECTOR_SIZE){
+	// corrupt header: the rest of the sector is reclaimed by collection
+	garbage[sector] += PATCH_STORE_SECTOR_SIZE-offset;
+	offset = PATCH_STORE_SECTOR_SIZE;
+	break;
+      }
+      if(record->magic == PATCH_STORE_RECORD_MAGIC &&
+	 record->deleted == PATCH_STORE_ERASED_WORD &&
+	 record->slot < MAX_USER_PATCHES)
+	addRecord(record);
+      else
+	garbage[sector] += length;
+      offset += length;
+    }
+    used[sector] = offset;
+  }else if(magic == PROGRAM_HEADER_MAGIC_V1 || magic == PROGRAM_HEADER_MAGIC_V2){
+    // one patch per sector: sector 11 holds slot 0, sector 8 holds slot 3
+    state[sector] = SECTOR_LEGACY;
+    used[sector] = PATCH_STORE_SECTOR_SIZE;
+    ProgramHeader* header = (ProgramHeader*)address;
+    uint8_t slot = PATCH_STORE_SECTORS-1-sector;
+    if(slot < MAX_USER_PATCHES && records[slot] == NULL){
+      patches[slot] = (void*)address;
+      sizes[slot] = (uintptr_t)header->endAddress - (uintptr_t)header->linkAddress;
+      // collection reclaims the space left over once the patch is in the log
+      uint32_t length = sizeof(uint32_t) + PATCH_STORE_RECORD_SIZE(sizes[slot]);
+      if(sizes[slot] < PATCH_STORE_SECTOR_SIZE && length < PATCH_STORE_SECTOR_SIZE)
+	garbage[sector] = PATCH_STORE_SECTOR_SIZE - length;
+    }else{
+      garbage[sector] = PATCH_STORE_SECTOR_SIZE;
+    }
+  }else if(magic == PATCH_STORE_ERASED_WORD && isErased(address, PATCH_STORE_SECTOR_SIZE)){
+    state[sector] = SECTOR_ERASED;
+  }else{
+    // interrupted collection or unknown contents
+    flash.unlock();
+    eraseSector(sector);
+    flash.lock();
+  }
+}
+
+void PatchStore::init(){
+  sequence = 0;
+  for(int i=0; i<MAX_USER_PATCHES; ++i)
+    clearSlot(i);
+  for(int i=0; i<PATCH_STORE_SECTORS; ++i)
+    scanSector(i);
+}
+
+int PatchStore::format(){
+  int ret = 0;
+  flash.unlock();
+  for(int i=0; i<PATCH_STORE_SECTORS; ++i)
+    if(eraseSector(i) != 0)
+      ret = -1;
+  flash.lock();
+  init();
+  return ret;
+}
+
+/* find a log sector with room for length bytes. flash must be unlocked */
+int PatchStore::allocate(uint32_t length){
+  for(int i=0; i<PATCH_STORE_SECTORS; ++i)
+    if(state[i] == SECTOR_LOG && used[i]+length <= PATCH_STORE_SECTOR_SIZE)
+      return i;
+  // start a new log sector, always leaving one erased sector spare
+  if(getErasedSectorCount() > 1){
+    int sector = getErasedSector();
+    uint32_t magic = PATCH_STORE_SECTOR_MAGIC;
+    if(flash.write(getSectorAddress(sector), &magic, sizeof(magic)) != 0)
+      return -1;
+    state[sector] = SECTOR_LOG;
+    used[sector] = sizeof(magic);
+    return sector;
+  }
+  return -1;
+}
+
+/*
+ * Copy the patch held by a legacy sector to a log record at address.
+ * Flash must be unlocked.
+ */
+int PatchStore::copyLegacyPatch(uint8_t slot, uint32_t address){
+  void* data = patches[slot];
+  uint32_t size = sizes[slot];
+  PatchStoreRecord record = { size, slot, sequence++, crc32(data, size, 0),
+			      PATCH_STORE_RECORD_MAGIC, PATCH_STORE_ERASED_WORD };
+  if(flash.write(address, &record, sizeof(record)) != 0 ||
+     flash.write(address+sizeof(record), data, size) != 0)
+    return -1;
+  records[slot] = (PatchStoreRecord*)address;
+  patches[slot] = (uint8_t*)records[slot] + sizeof(PatchStoreRecord);
+  return 0;
+}
+
+/*
+ * Copy the live records of the sector with the most garbage into the
+ * spare sector, then erase it. A legacy sector counts the space its
+ * patch leaves free as garbage, and has its patch copied like a record.
+ * Flash must be unlocked.
+ * Returns 0 if a sector was reclaimed.
+ */
+int PatchStore::collect(){
+  int victim = -1;
+  for(int i=0; i<PATCH_STORE_SECTORS; ++i)
+    if(state[i] != SECTOR_ERASED && garbage[i] > 0 &&
+       (victim < 0 || garbage[i] > garbage[victim]))
+      victim = i;
+  int spare = getErasedSector();
+  if(victim < 0 || spare < 0)
+    return -1;
+  uint32_t address = getSectorAddress(spare);
+  uint32_t offset = sizeof(uint32_t);
+  uint8_t legacy = PATCH_STORE_SECTORS-1-victim;
+  if(state[victim] == SECTOR_LEGACY && records[legacy] == NULL && patches[legacy] != NULL){
+    if(copyLegacyPatch(legacy, address+offset) != 0)
+      return -1;
+    offset += PATCH_STORE_RECORD_SIZE(sizes[legacy]);
+  }
+  for(int slot=0; slot<MAX_USER_PATCHES; ++slot){
+    PatchStoreRecord* record = records[slot];
+    if(record != NULL && getSectorIndex(record) == victim){
+      uint32_t length = PATCH_STORE_RECORD_SIZE(record->size);
+      if(flash.write(address+offset, record, length) != 0)
+	return -1;
+      records[slot] = (PatchStoreRecord*)(address+offset);
+      patches[slot] = (uint8_t*)records[slot] + sizeof(PatchStoreRecord);
+      offset += length;
+    }
+  }
+  // the sector magic is written last, so that an interrupted
+  // collection leaves the victim sector intact
+  uint32_t magic = PATCH_STORE_SECTOR_MAGIC;
+  if(flash.write(address, &magic, sizeof(magic)) != 0)
+    return -1;
+  state[spare] = SECTOR_LOG;
+  used[spare] = offset;
+  garbage[spare] = 0;
+  return eraseSector(victim);
+}
+
+/* flash must be unlocked */
+int PatchStore::remove(uint8_t slot){
+  int ret = 0;
+  PatchStoreRecord* record = records[slot];
+  if(record != NULL){
+    uint32_t deleted = 0;
+    ret = flash.write((uintptr_t)&record->deleted, &deleted, sizeof(deleted));
+    garbage[getSectorIndex(record)] += PATCH_STORE_RECORD_SIZE(record->size);
+  }else if(patches[slot] != NULL){
+    ret = eraseSector(getSectorIndex(patches[slot]));
+  }
+  clearSlot(slot);
+  return ret;
+}
+
+int PatchStore::write(uint8_t slot, void* data, uint32_t size){
+  uint32_t length = PATCH_STORE_RECORD_SIZE(size);
+  if(slot >= MAX_USER_PATCHES || length > PATCH_STORE_SECTOR_SIZE-sizeof(uint32_t))
+    return -1;
+  flash.unlock();
+  if(patches[slot] != NULL && records[slot] == NULL && getErasedSectorCount() == 0)
+    remove(slot); // a full legacy store has no spare: free up the sector being replaced
+  int sector = allocate(length);
+  while(sector < 0 && collect() == 0)
+    sector = allocate(length);
+  int ret = -1;
+  if(sector >= 0){
+    uint32_t address = getSectorAddress(sector)+used[sector];
+    PatchStoreRecord record = { size, slot, sequence++, crc32(data, size, 0),
+				PATCH_STORE_RECORD_MAGIC, PATCH_STORE_ERASED_WORD };
+    used[sector] += length;
+    ret = flash.write(address, &record, offsetof(PatchStoreRecord, magic));
+    if(ret == 0)
+      ret = flash.write(address+sizeof(PatchStoreRecord), data, size);
+    if(ret == 0) // commit
+      ret = flash.write(address+offsetof(PatchStoreRecord, magic),
+			&record.magic, sizeof(record.magic));
+    if(ret == 0){
+      remove(slot);
+      addRecord((PatchStoreRecord*)address);
+    }else{
+      garbage[sector] += length;
+    }
+  }
+  flash.lock();
+  return ret;
+}
+
+int PatchStore::erase(uint8_t slot){
+  if(slot >= MAX_USER_PATCHES)
+    return -1;
+  flash.unlock();
+  int ret = remove(slot);
+  flash.lock();
+  return ret;
+}
+
+void* PatchStore::getPatchAddress(uint8_t slot){
+  if(slot >= MAX_USER_PATCHES)
+    return NULL;
+  return patches[slot];
+}
+
+uint32_t PatchStore::getPatchSize(uint8_t slot){
+  if(slot >= MAX_USER_PATCHES)
+    return 0;
+  return sizes[slot];
+}
+
+/* patches in legacy sectors have no checksum */
+bool PatchStore::hasPatchChecksum(uint8_t slot){
+  return slot < MAX_USER_PATCHES && records[slot] != NULL;
+}
+
+uint32_t PatchStore::getPatchChecksum(uint8_t slot){
+  if(!hasPatchChecksum(slot))
+    return 0;
+  return records[slot]->checksum;
+}
+
+uint32_t PatchStore::getFreeSpace(){
+  uint32_t space = 0;
+  for(int i=0; i<PATCH_STORE_SECTORS; ++i)
+    if(state[i] != SECTOR_ERASED)
+      space += PATCH_STORE_SECTOR_SIZE - used[i] + garbage[i];
+  int erased = getErasedSectorCount();
+  if(erased > 1)
+    space += (erased-1)*(PATCH_STORE_SECTOR_SIZE-sizeof(uint32_t));
+  return space;
+}
@@ -0,0 +1,82 @@
+#ifndef __PatchStore_h__
+#define __PatchStore_h__
+
+#include <stdint.h>
+#include "device.h"
+#include "FlashBackend.h"
+
+#define PATCH_STORE_SECTOR_MAGIC     0xDADAB00C
+#define PATCH_STORE_RECORD_MAGIC     0xDADAFEED
+#define PATCH_STORE_SECTORS          4
+#define PATCH_STORE_SECTOR_SIZE      (128*1024)
+
+/*
+ * A record header precedes every patch in the store.
+ * The size, slot, sequence and checksum words are programmed first, followed by
+ * the patch data. The magic word is programmed last to commit the record.
+ * The deleted word is cleared when the record is superseded or erased.
+ */
+struct PatchStoreRecord {
+  uint32_t size;
+  uint32_t slot;
+  uint32_t sequence;
+  uint32_t checksum; // crc32 of the patch data
+  uint32_t magic;
+  uint32_t deleted;
+};
+
+/*
+ * Log-structured patch store in flash sectors 8-11.
+ * Patches are appended to a sector until it is full, so several small
+ * patches share one 128k sector. One sector is always kept erased as a
+ * spare: garbage collection copies the live records of a sector into the
+ * spare, then erases the old sector which becomes the new spare.
+ * Sectors written in the old one-patch-per-sector layout are still read.
+ * When space is needed, garbage collection moves the patch of a legacy
+ * sector into the log like any other live record.
+ */
+class PatchStore {
+private:
+  FlashBackend& flash;
+  uint32_t base;
+  enum SectorState {
+    SECTOR_ERASED = 0,
+    SECTOR_LOG,
+    SECTOR_LEGACY
+  };
+  SectorState state[PATCH_STORE_SECTORS];
+  uint32_t used[PATCH_STORE_SECTORS];    // next free offset in log sectors
+  uint32_t garbage[PATCH_STORE_SECTORS]; // bytes held by dead records
+  PatchStoreRecord* records[MAX_USER_PATCHES];
+  void* patches[MAX_USER_PATCHES];
+  uint32_t sizes[MAX_USER_PATCHES];
+  uint32_t sequence;
+  uint32_t getSectorAddress(int sector);
+  int getSectorIndex(void* address);
+  int getErasedSectorCount();
+  int getErasedSector();
+  bool isErased(uint32_t address, uint32_t size);
+  int copyLegacyPatch(uint8_t slot, uint32_t address);
+  int eraseSector(int sector);
+  void scanSector(int sector);
+  void addRecord(PatchStoreRecord* record);
+  void clearSlot(uint8_t slot);
+  int remove(uint8_t slot);
+  int allocate(uint32_t length);
+  int collect();
+public:
+  PatchStore(FlashBackend& backend, uint32_t address);
+  void init();
+  int format();
+  int write(uint8_t slot, void* data, uint32_t size);
+  int erase(uint8_t slot);
+  void* getPatchAddress(uint8_t slot);
+  uint32_t getPatchSize(uint8_t slot);
+  bool hasPatchChecksum(uint8_t slot);
+  uint32_t getPatchChecksum(uint8_t slot);
+  uint32_t getFreeSpace();
+};
+
+extern PatchStore storage;
+
+#endif // __PatchStore_h__
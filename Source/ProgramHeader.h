@@ -3,10 +3,28 @@
 
 #include <stdint.h>
 
+#define PROGRAM_HEADER_MAGIC_V1             0xDADAC0DE
+#define PROGRAM_HEADER_MAGIC_V2             0xDADAC0DF
+#define PROGRAM_HEADER_PARAMETERS           8  /* parameters A to H */
+#define PROGRAM_HEADER_PARAMETER_NAME_SIZE  16
+
 #ifdef __cplusplus
  extern "C" {
 #endif
 
+   typedef enum {
+     PROGRAM_SECTION_TEXT = 0, /* code */
+     PROGRAM_SECTION_RODATA,
+     PROGRAM_SECTION_DATA,     /* initialised data */
+     PROGRAM_SECTION_BSS,      /* zero initialised data, not part of the image */
+     PROGRAM_SECTIONS
+   } ProgramSectionId;
+
+   typedef struct {
+     uint32_t* begin;
+     uint32_t* end;
+   } ProgramSection;
+
    struct ProgramHeader {
      uint32_t magic;
      uint32_t* linkAddress;
@@ -16,8 +34,27 @@
      uint32_t* stackEnd;
      ProgramVector* programVector;
      char programName[24];
+     /* v2 header, only valid if magic is PROGRAM_HEADER_MAGIC_V2 */
+     uint32_t headerSize;    /* size of the header as built, may grow in later versions */
+     uint32_t checksum;      /* crc32 of the image following the header */
+     ProgramSection sections[PROGRAM_SECTIONS];
+     uint32_t ccmHeapSize;   /* heap required in CCM RAM */
+     uint32_t extHeapSize;   /* heap required in external RAM */
+     uint8_t inputs;
+     uint8_t outputs;
+     char parameterNames[PROGRAM_HEADER_PARAMETERS][PROGRAM_HEADER_PARAMETER_NAME_SIZE];
    };
 
+   static inline int isProgramHeader(const struct ProgramHeader* header){
+     return header->magic == PROGRAM_HEADER_MAGIC_V1 ||
+       (header->magic == PROGRAM_HEADER_MAGIC_V2 &&
+	header->headerSize >= sizeof(struct ProgramHeader));
+   }
+
+   static inline int isProgramHeaderV2(const struct ProgramHeader* header){
+     return header->magic == PROGRAM_HEADER_MAGIC_V2;
+   }
+
 #ifdef __cplusplus
 }
 #endif
@@ -11,7 +11,15 @@
 #include "ApplicationSettings.h"
 #include "CodecController.h"
 #include "Owl.h"
-// #include "MidiController.h"
+#include "PatchStore.h"
+#include "BackupStore.h"
+#include "DeferredLog.h"
+#include "MidiController.h"
+#include "OpenWareMidiControl.h"
+#include "midicontrol.h"
+#include "sysex.h"
+#include "crc32.h"
+#include "flashupdate.h"
 
 // #define AUDIO_TASK_SUSPEND
 // #define AUDIO_TASK_SEMAPHORE
@@ -44,12 +52,6 @@ volatile ProgramVectorAudioStatus audioStatus = AUDIO_IDLE_STATUS;
 static DynamicPatchDefinition dynamo;
 static DynamicPatchDefinition flashPatches[MAX_USER_PATCHES];
 
-static uint32_t getFlashAddress(int sector){
-  uint32_t addr = ADDR_FLASH_SECTOR_11;
-  addr -= sector*128*1024; // count backwards by 128k blocks, ADDR_FLASH_SECTOR_7 is at 0x08060000
-  return addr;
-}
-
 TaskHandle_t xProgramHandle = NULL;
 TaskHandle_t xManagerHandle = NULL;
 TaskHandle_t xFlashTaskHandle = NULL;
@@ -66,6 +68,9 @@ uint8_t programStack[PROGRAMSTACK_SIZE] CCM;
 #define ERASE_FLASH_NOTIFICATION    0x08
 #define PROGRAM_CHANGE_NOTIFICATION 0x10
 // #define MIDI_SEND_NOTIFICATION      0x20
+#define SEND_FLASH_NOTIFICATION     0x80
+#define LOAD_PROGRAM_NOTIFICATION   0x100
+#define SEND_TELEMETRY_NOTIFICATION 0x200
 
 PatchDefinition* getPatchDefinition(){
   return program.getPatchDefinition();
@@ -75,13 +80,28 @@ volatile int flashSectorToWrite;
 volatile void* flashAddressToWrite;
 volatile uint32_t flashSizeToWrite;
 
+/*
+ * A flash command, latched by the manager task when it starts a flash task
+ * and passed to it as the task parameter. Only one flash task runs at a
+ * time, so the command does not change under it.
+ */
+struct FlashCommand {
+  int sector;
+  uint8_t* address;
+  uint32_t size;
+};
+static FlashCommand flashCommand;
+
+/* flash tasks clear their handle as they finish, so that the next one may start */
+static void exitFlashTask(){
+  xFlashTaskHandle = NULL;
+  vTaskDelete(NULL);
+}
+volatile uint8_t programIndexToLoad;
+
 static void eraseFlashProgram(int sector){
-  uint32_t addr = getFlashAddress(sector);
-  eeprom_unlock();
-  int ret = eeprom_erase(addr);
-  eeprom_lock();
-  if(ret != 0)
-    setErrorMessage(PROGRAM_ERROR, "Failed to erase flash sector");
+  if(storage.erase(sector) != 0)
+    setErrorMessage(PROGRAM_ERROR, "Failed to erase flash program");
 }
 
 extern "C" {
@@ -109,6 +129,23 @@ extern "C" {
     for(;;);
   }
 
+  /*
+   * update one firmware sector, unless its contents are unchanged.
+   * the whole sector is compared, so that no old firmware is left past
+   * the end of a shorter image.
+   * must run from RAM (don't make this static!)
+   */
+  __attribute__ ((section (".coderam")))
+  void flashFirmwareSector(uint32_t sector, uint32_t address, uint32_t length, 
+			   uint8_t* source, uint32_t size){
+    uint32_t offset = address - ADDR_FLASH_SECTOR_2;
+    uint32_t count = 0;
+    if(offset < size)
+      count = size - offset < length ? size - offset : length;
+    flash_update_sector(sector, address, length, source + offset, count);
+    toggleLed(); // inline
+  }
+
   /*
    * re-program firmware: this entire function and all subroutines must run from RAM
    * (don't make this static!)
@@ -118,41 +155,23 @@ extern "C" {
     __disable_irq(); // Disable ALL interrupts. Can only be executed in Privileged modes.
     setLed(RED);
     eeprom_unlock();
-    if(size > (16+16+64+128)*1024){
-      eeprom_erase_sector(FLASH_Sector_6);
-      toggleLed(); // inline
-    }
-    if(size > (16+16+64)*1024){
-      eeprom_erase_sector(FLASH_Sector_5);
-      toggleLed();
-    }
-    if(size > (16+16)*1024){
-      eeprom_erase_sector(FLASH_Sector_4);
-      toggleLed();
-    }
-    if(size > 16*1024){
-      eeprom_erase_sector(FLASH_Sector_3);
-      toggleLed();
-    }
-    eeprom_erase_sector(FLASH_Sector_2);
-    toggleLed();
-    eeprom_write_block(ADDR_FLASH_SECTOR_2, source, size);
+    flashFirmwareSector(FLASH_Sector_2, ADDR_FLASH_SECTOR_2, 16*1024, source, size);
+    flashFirmwareSector(FLASH_Sector_3, ADDR_FLASH_SECTOR_3, 16*1024, source, size);
+    flashFirmwareSector(FLASH_Sector_4, ADDR_FLASH_SECTOR_4, 64*1024, source, size);
+    flashFirmwareSector(FLASH_Sector_5, ADDR_FLASH_SECTOR_5, 128*1024, source, size);
+    flashFirmwareSector(FLASH_Sector_6, ADDR_FLASH_SECTOR_6, 128*1024, source, size);
     eeprom_lock();
     eeprom_wait();
     NVIC_SystemReset(); // (static inline)
   }
 
   void programFlashTask(void* p){
-    int sector = flashSectorToWrite;
-    uint32_t size = flashSizeToWrite;
-    uint8_t* source = (uint8_t*)flashAddressToWrite;
+    FlashCommand* command = (FlashCommand*)p;
+    int sector = command->sector;
+    uint32_t size = command->size;
+    uint8_t* source = command->address;
     if(sector >= 0 && sector < MAX_USER_PATCHES && size <= 128*1024){
-      uint32_t addr = getFlashAddress(sector);
-      eeprom_unlock();
-      int ret = eeprom_erase(addr);
-      if(ret == 0)
-	ret = eeprom_write_block(addr, source, size);
-      eeprom_lock();
+      int ret = storage.write(sector, source, size);
       registry.init();
       if(ret == 0){
 	// load and run program
@@ -163,19 +182,90 @@ extern "C" {
       }else{
 	setErrorMessage(PROGRAM_ERROR, "Failed to write program to flash");
       }
-    }else if(sector == 0xff && size < MAX_SYSEX_FIRMWARE_SIZE){
+    }else if(sector == 0xff && size + 16 <= MAX_SYSEX_FIRMWARE_SIZE){
+      // store the size and checksum with the image, so that it can be sent back exactly
+      size = flash_append_footer(source, size, crc32(source, size, 0));
       flashFirmware(source, size);
     }else{
       setErrorMessage(PROGRAM_ERROR, "Invalid flash program command");
     }
-    vTaskDelete(NULL);
+    exitFlashTask();
+  }
+
+  /* encode a 32-bit unsigned integer as 5 bytes of sysex data, msb first */
+  static uint8_t* encodeInt(uint8_t* sysex, uint32_t value){
+    uint8_t buf[4] = { (uint8_t)(value >> 24), (uint8_t)(value >> 16),
+		       (uint8_t)(value >> 8), (uint8_t)value };
+    return sysex + data_to_sysex(buf, sysex, 4);
+  }
+
+  /* wait, rather than spin, until a sysex message fits in the USB buffer */
+  static void sendSysExWhenReady(uint8_t* data, uint16_t size){
+    // 3 bytes per USB-MIDI packet, plus start and end packets
+    while(midi_usb_buffer_space() < (size/3+2)*4)
+      vTaskDelay(1);
+    midi.sendSysEx(data, size);
+  }
+
+  /*
+   * send a stored patch, or the firmware, in the same format as an upload:
+   * a package with the size, data packages, and a package with the crc32
+   */
+  void sendFlashTask(void* p){
+    int sector = ((FlashCommand*)p)->sector;
+    uint8_t* source = NULL;
+    uint32_t size = 0;
+    uint32_t checksum = 0;
+    bool verify = false;
+    if(sector == 0xff){
+      if(flash_find_footer(ADDR_FLASH_SECTOR_2, MAX_SYSEX_FIRMWARE_SIZE, &size, &checksum) != 0){
+	setErrorMessage(PROGRAM_ERROR, "Firmware size unknown");
+	exitFlashTask();
+      }
+      source = (uint8_t*)ADDR_FLASH_SECTOR_2;
+      verify = true;
+    }else if(sector >= 0 && sector < MAX_USER_PATCHES){
+      source = (uint8_t*)storage.getPatchAddress(sector);
+      size = storage.getPatchSize(sector);
+      // patches in legacy sectors have no checksum to compare with
+      verify = storage.hasPatchChecksum(sector);
+      checksum = storage.getPatchChecksum(sector);
+    }
+    if(source == NULL || size == 0){
+      setErrorMessage(PROGRAM_ERROR, "No program to send");
+      exitFlashTask();
+    }
+    // 28 groups of 7 bytes: the message fits in MIDI_MAX_MESSAGE_SIZE when sent back
+    const uint32_t chunk = 28*7;
+    static uint8_t buffer[1+5+chunk/7*8]; // keep off the small task stack
+    uint8_t* end;
+    uint32_t idx = 0;
+    uint32_t crc = 0;
+    buffer[0] = SYSEX_FIRMWARE_UPLOAD;
+    end = encodeInt(encodeInt(buffer+1, idx++), size);
+    sendSysExWhenReady(buffer, end-buffer);
+    for(uint32_t i=0; i<size; i+=chunk){
+      uint32_t len = min(chunk, size-i);
+      crc = crc32(source+i, len, crc);
+      end = encodeInt(buffer+1, idx++);
+      end += data_to_sysex(source+i, end, len);
+      sendSysExWhenReady(buffer, end-buffer);
+    }
+    if(verify && crc != checksum){
+      // send the stored checksum, so that the receiver sees the corruption
+      setErrorMessage(PROGRAM_ERROR, sector == 0xff ? "Firmware checksum mismatch" : "Patch checksum mismatch");
+      crc = checksum;
+    }
+    end = encodeInt(encodeInt(buffer+1, idx), crc);
+    sendSysExWhenReady(buffer, end-buffer);
+    exitFlashTask();
   }
 
   void eraseFlashTask(void* p){
-    int sector = flashSectorToWrite;
+    int sector = ((FlashCommand*)p)->sector;
     if(sector == 0xff){
-      for(int i=0; i<MAX_USER_PATCHES; ++i)
-	eraseFlashProgram(i);
+      if(storage.format() != 0)
+	setErrorMessage(PROGRAM_ERROR, "Failed to erase flash programs");
       settings.clearFlash();
     }else if(sector >= 0 && sector < MAX_USER_PATCHES){
       eraseFlashProgram(sector);
@@ -183,7 +273,7 @@ extern "C" {
       setErrorMessage(PROGRAM_ERROR, "Invalid flash erase command");
     }
     registry.init();
-    vTaskDelete(NULL);
+    exitFlashTask();
   }
 
 #ifdef BUTTON_PROGRAM_CHANGE
@@ -249,6 +339,12 @@ void ProgramManager::audioReady(){
 #else /* AUDIO_TASK_DIRECT */
   audioStatus = AUDIO_READY_STATUS;
   // getProgramVector()->status = AUDIO_READY_STATUS;
+  // wake the program task if it is waiting for this block
+  if(xProgramHandle != NULL){
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(xProgramHandle, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+  }
 #endif
 }
 
@@ -271,7 +367,9 @@ void ProgramManager::programReady(){
 #elif defined AUDIO_TASK_YIELD
   taskYIELD(); // this will only suspend the task if another is ready to run
 #elif defined AUDIO_TASK_DIRECT
-  while(audioStatus != AUDIO_READY_STATUS);
+  // sleep rather than spin, so that lower priority tasks get the time left over
+  while(audioStatus != AUDIO_READY_STATUS)
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
   audioStatus = AUDIO_PROCESSING_STATUS;
 #else
   #error "Invalid AUDIO_TASK setting"
@@ -337,6 +435,11 @@ void ProgramManager::resetProgram(bool isr){
     notifyManager(STOP_PROGRAM_NOTIFICATION|START_PROGRAM_NOTIFICATION);
 }
 
+/* true until the manager has deleted the program task */
+bool ProgramManager::isProgramRunning(){
+  return xProgramHandle != NULL;
+}
+
 void ProgramManager::startProgramChange(bool isr){
   if(isr)
     notifyManagerFromISR(STOP_PROGRAM_NOTIFICATION|PROGRAM_CHANGE_NOTIFICATION);
@@ -344,6 +447,15 @@ void ProgramManager::startProgramChange(bool isr){
     notifyManager(STOP_PROGRAM_NOTIFICATION|PROGRAM_CHANGE_NOTIFICATION);
 }
 
+/* load a program from the manager task, once the running program has stopped */
+void ProgramManager::changeProgram(uint8_t index, bool isr){
+  programIndexToLoad = index;
+  if(isr)
+    notifyManagerFromISR(STOP_PROGRAM_NOTIFICATION|LOAD_PROGRAM_NOTIFICATION);
+  else
+    notifyManager(STOP_PROGRAM_NOTIFICATION|LOAD_PROGRAM_NOTIFICATION);
+}
+
 void ProgramManager::loadProgram(uint8_t pid){
   PatchDefinition* def = registry.getPatchDefinition(pid);
   if(def != NULL && def != patchdef && def->getProgramVector() != NULL){
@@ -401,21 +513,31 @@ uint32_t ProgramManager::getHeapMemoryUsed(){
 
 void ProgramManager::runManager(){
   uint32_t ulNotifiedValue = 0;
-  // TickType_t xMaxBlockTime = pdMS_TO_TICKS( 1000 );
-  TickType_t xMaxBlockTime = portMAX_DELAY;  /* Block indefinitely. */
+  /* wake up periodically to send logged messages, so that logging never
+     has to notify this task */
+  TickType_t xMaxBlockTime = pdMS_TO_TICKS(DEFERRED_LOG_FLUSH_MS);
   for(;;){
-    /* Block indefinitely (without a timeout, so no need to check the function's
-       return value) to wait for a notification.
+    /* Wait for a notification, or for the timeout with ulNotifiedValue 0.
        Bits in this RTOS task's notification value are set by the notifying
        tasks and interrupts to indicate which events have occurred. */
+    ulNotifiedValue = 0;
     xTaskNotifyWait(pdFALSE,          /* Don't clear any notification bits on entry. */
 		    UINT32_MAX,       /* Reset the notification value to 0 on exit. */
 		    &ulNotifiedValue, /* Notified value pass out in ulNotifiedValue. */
 		    xMaxBlockTime ); 
+    // send messages before a program they may refer to is replaced
+    debugLog.flush();
+    if(ulNotifiedValue & SEND_TELEMETRY_NOTIFICATION){
+      midi.sendTelemetry();
+      ulNotifiedValue &= ~SEND_TELEMETRY_NOTIFICATION;
+    }
+    if(ulNotifiedValue == 0)
+      continue;
     if(ulNotifiedValue & STOP_PROGRAM_NOTIFICATION){ // stop      
       audioStatus = AUDIO_EXIT_STATUS;
       codec.softMute(true);
       if(xProgramHandle != NULL){
+	backup.saveState();
 	programVector = &staticVector;
 	vTaskDelete(xProgramHandle);
 	xProgramHandle = NULL;
@@ -424,6 +546,10 @@ void ProgramManager::runManager(){
     // allow idle task to garbage collect if necessary
     vTaskDelay(20);
     // vTaskDelay(pdMS_TO_TICKS(200));
+    if(ulNotifiedValue & LOAD_PROGRAM_NOTIFICATION){ // load program
+      loadProgram(programIndexToLoad);
+      ulNotifiedValue |= START_PROGRAM_NOTIFICATION;
+    }
     if(ulNotifiedValue & START_PROGRAM_NOTIFICATION){ // start
       PatchDefinition* def = getPatchDefinition();
       if(xProgramHandle == NULL && def != NULL){
@@ -441,15 +567,33 @@ void ProgramManager::runManager(){
 	  setErrorMessage(PROGRAM_ERROR, "Failed to start Program Change task");
       }
 #endif /* BUTTON_PROGRAM_CHANGE */
+    }else if((ulNotifiedValue & (PROGRAM_FLASH_NOTIFICATION|ERASE_FLASH_NOTIFICATION|SEND_FLASH_NOTIFICATION))
+	     && xFlashTaskHandle != NULL){
+      // one flash task at a time: a send must not be erased or rewritten under it
+      setErrorMessage(PROGRAM_ERROR, "Flash busy");
     }else if(ulNotifiedValue & PROGRAM_FLASH_NOTIFICATION){ // program flash
-      BaseType_t ret = xTaskCreate(programFlashTask, "Flash Write", FLASH_TASK_STACK_SIZE, NULL, FLASH_TASK_PRIORITY, &xFlashTaskHandle);
+      flashCommand.sector = flashSectorToWrite;
+      flashCommand.address = (uint8_t*)flashAddressToWrite;
+      flashCommand.size = flashSizeToWrite;
+      BaseType_t ret = xTaskCreate(programFlashTask, "Flash Write", FLASH_TASK_STACK_SIZE, &flashCommand, FLASH_TASK_PRIORITY, &xFlashTaskHandle);
       if(ret != pdPASS){
+	xFlashTaskHandle = NULL;
 	setErrorMessage(PROGRAM_ERROR, "Failed to start Flash Write task");
       }
     }else if(ulNotifiedValue & ERASE_FLASH_NOTIFICATION){ // erase flash
-      BaseType_t ret = xTaskCreate(eraseFlashTask, "Flash Erase", FLASH_TASK_STACK_SIZE, NULL, FLASH_TASK_PRIORITY, &xFlashTaskHandle);
-      if(ret != pdPASS)
+      flashCommand.sector = flashSectorToWrite;
+      BaseType_t ret = xTaskCreate(eraseFlashTask, "Flash Erase", FLASH_TASK_STACK_SIZE, &flashCommand, FLASH_TASK_PRIORITY, &xFlashTaskHandle);
+      if(ret != pdPASS){
+	xFlashTaskHandle = NULL;
 	setErrorMessage(PROGRAM_ERROR, "Failed to start Flash Erase task");
+      }
+    }else if(ulNotifiedValue & SEND_FLASH_NOTIFICATION){ // send flash
+      flashCommand.sector = flashSectorToWrite;
+      BaseType_t ret = xTaskCreate(sendFlashTask, "Flash Send", FLASH_TASK_STACK_SIZE, &flashCommand, FLASH_TASK_PRIORITY, &xFlashTaskHandle);
+      if(ret != pdPASS){
+	xFlashTaskHandle = NULL;
+	setErrorMessage(PROGRAM_ERROR, "Failed to start Flash Send task");
+      }
     }
   }
 }
@@ -457,23 +601,49 @@ void ProgramManager::runManager(){
 PatchDefinition* ProgramManager::getPatchDefinitionFromFlash(uint8_t sector){
   if(sector >= MAX_USER_PATCHES)
     return NULL;
-  uint32_t addr = getFlashAddress(sector);
-  ProgramHeader* header = (ProgramHeader*)addr;
+  ProgramHeader* header = (ProgramHeader*)storage.getPatchAddress(sector);
+  if(header == NULL)
+    return NULL;
   DynamicPatchDefinition* def = &flashPatches[sector];
   uint32_t size = (uint32_t)header->endAddress - (uint32_t)header->linkAddress;
-  if(header->magic == 0xDADAC0DE && size <= 80*1024){
-    if(def->load((void*)addr, size) && def->verify())
+  if(isProgramHeader(header) && size <= 80*1024 && size <= storage.getPatchSize(sector)){
+    if(def->load((void*)header, size) && def->verify()){
+      if(storage.hasPatchChecksum(sector) && storage.getPatchSize(sector) == size)
+	def->setChecksum(storage.getPatchChecksum(sector));
       return def;
+    }
   }
   return NULL;
 }
 
 void ProgramManager::eraseProgramFromFlash(uint8_t sector){
+  if(xFlashTaskHandle != NULL){
+    setErrorMessage(PROGRAM_ERROR, "Flash busy");
+    return;
+  }
   flashSectorToWrite = sector;
   notifyManagerFromISR(STOP_PROGRAM_NOTIFICATION|ERASE_FLASH_NOTIFICATION);
 }
 
+void ProgramManager::sendProgramFromFlash(uint8_t sector){
+  if(xFlashTaskHandle != NULL){
+    setErrorMessage(PROGRAM_ERROR, "Flash busy");
+    return;
+  }
+  flashSectorToWrite = sector;
+  notifyManagerFromISR(SEND_FLASH_NOTIFICATION);
+}
+
+/* send a telemetry frame from the manager task, rather than from the USB interrupt */
+void ProgramManager::sendTelemetryFromISR(){
+  notifyManagerFromISR(SEND_TELEMETRY_NOTIFICATION);
+}
+
 void ProgramManager::saveProgramToFlash(uint8_t sector, void* address, uint32_t length){
+  if(xFlashTaskHandle != NULL){
+    setErrorMessage(PROGRAM_ERROR, "Flash busy");
+    return;
+  }
   flashSectorToWrite = sector;
   flashAddressToWrite = address;
   flashSizeToWrite = length;
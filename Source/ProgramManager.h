@@ -20,7 +20,9 @@ public:
   void startProgram(bool isr);
   void exitProgram(bool isr);
   void resetProgram(bool isr); /* exit and restart program */
+  bool isProgramRunning();
   void startProgramChange(bool isr);
+  void changeProgram(uint8_t index, bool isr); /* exit, load and start another program */
   /* void sendMidiData(int type, bool isr); */
 
   void audioReady();
@@ -35,6 +37,8 @@ public:
 
   void eraseProgramFromFlash(uint8_t sector);
   void saveProgramToFlash(uint8_t sector, void* address, uint32_t length);
+  void sendProgramFromFlash(uint8_t sector);
+  void sendTelemetryFromISR();
   PatchDefinition* getPatchDefinitionFromFlash(uint8_t sector);
 
   uint32_t getCyclesPerBlock();
@@ -3,45 +3,78 @@
 #include "ServiceCall.h"
 #include "ApplicationSettings.h"
 #include "OpenWareMidiControl.h"
+#include "TempoTracker.h"
+#include "ParameterAutomation.h"
+#include "ProgramVector.h"
+#include "DeferredLog.h"
+#include "clock.h"
 
 #include "FastLogTable.h"
 #include "FastPowTable.h"
 
+/* indexed by log2(len)-4 */
+static const arm_cfft_instance_f32* const cfft_instances[] = {
+  &arm_cfft_sR_f32_len16,
+  &arm_cfft_sR_f32_len32,
+  &arm_cfft_sR_f32_len64,
+  &arm_cfft_sR_f32_len128,
+  &arm_cfft_sR_f32_len256,
+  &arm_cfft_sR_f32_len512,
+  &arm_cfft_sR_f32_len1024,
+  &arm_cfft_sR_f32_len2048,
+  &arm_cfft_sR_f32_len4096
+};
+
 int SERVICE_ARM_CFFT_INIT_F32(arm_cfft_instance_f32* instance, int len){
-  switch(len) { 
-  case 16:
-    *instance = arm_cfft_sR_f32_len16;
-    break;
-  case 32:
-    *instance = arm_cfft_sR_f32_len32;
-    break;
-  case 64:
-    *instance = arm_cfft_sR_f32_len64;
-    break;
-  case 128:
-    *instance = arm_cfft_sR_f32_len128;
-    break;
-  case 256:
-    *instance = arm_cfft_sR_f32_len256;
-    break;
-  case 512:
-    *instance = arm_cfft_sR_f32_len512;
-    break;
-  case 1024:
-    *instance = arm_cfft_sR_f32_len1024;
-    break;      
-  case 2048:
-    *instance = arm_cfft_sR_f32_len2048;
-    break;
-  case 4096:
-    *instance = arm_cfft_sR_f32_len4096;
-    break;
-  default:
+  if(len < 16 || len > 4096 || (len & (len-1)) != 0)
     return OWL_SERVICE_INVALID_ARGS;
-  }
+  *instance = *cfft_instances[__builtin_ctz(len)-4];
   return OWL_SERVICE_OK;
 }
 
+struct SystemResource {
+  const char* name;
+  const void* data;
+  uint32_t size;
+};
+
+/* indexed by resource id */
+static const SystemResource resources[] = {
+  { SYSTEM_TABLE_LOG, fast_log_table, fast_log_table_size },
+  { SYSTEM_TABLE_POW, fast_pow_table, fast_pow_table_size }
+};
+#define SYSTEM_RESOURCES (int)(sizeof(resources)/sizeof(resources[0]))
+
+/* look up a resource by name, for patches built before resource ids */
+static int getResourceId(const char* name){
+  for(int i=0; i<SYSTEM_RESOURCES; ++i)
+    if(strncmp(resources[i].name, name, 3) == 0)
+      return i;
+  return -1;
+}
+
+/*
+ * Resolve any number of resources in one call. Parameters come in
+ * threes: name or &id, &array and &size.
+ */
+static int SERVICE_GET_ARRAYS(void** params, int len, bool byName){
+  int ret = OWL_SERVICE_OK;
+  for(int index=0; len >= index+3; index+=3){
+    int id = byName ? getResourceId((const char*)params[index]) : *(int*)params[index];
+    void** array = (void**)params[index+1];
+    int* size = (int*)params[index+2];
+    if(id >= 0 && id < SYSTEM_RESOURCES){
+      *array = (void*)resources[id].data;
+      *size = resources[id].size;
+    }else{
+      *array = NULL;
+      *size = 0;
+      ret = OWL_SERVICE_INVALID_ARGS;
+    }
+  }
+  return ret;
+}
+
 int serviceCall(int service, void** params, int len){
   int ret = OWL_SERVICE_INVALID_ARGS;
   switch(service){
@@ -87,29 +120,44 @@ int serviceCall(int service, void** params, int len){
     }
     break;
   }
-  case OWL_SERVICE_GET_ARRAY: {
-    // get array and array size
-    // expects three parameters: name, &array and &size
-    int index = 0;
-    ret = OWL_SERVICE_OK;
-    if(len >= index+3){
-      char* p = (char*)params[index++];
-      void** array = (void**)params[index++];
-      int* size = (int*)params[index++];
-      if(strncmp(SYSTEM_TABLE_LOG, p, 3) == 0){
-	*array = (void*)fast_log_table;
-	*size = fast_log_table_size;
-      }else if(strncmp(SYSTEM_TABLE_POW, p, 3) == 0){
-	*array = (void*)fast_pow_table;
-	*size = fast_pow_table_size;
-      }else{
-	*array = NULL;
-	*size = 0;
-	ret = OWL_SERVICE_INVALID_ARGS;
+  case OWL_SERVICE_GET_TEMPO:
+    // expects two parameters: &bpm and &phase, bpm is 0 if there is no tempo
+    if(len == 2){
+      uint32_t now = getMicroseconds();
+      *(float*)params[0] = tempo.getBeatsPerMinute(now);
+      *(float*)params[1] = tempo.getBeatPhase(now);
+      ret = OWL_SERVICE_OK;
+    }
+    break;
+  case OWL_SERVICE_GET_PARAMETER_SAMPLES:
+    // expects &pid, a float buffer and &size: the automated value of a parameter for each sample
+    if(len == 3){
+      ProgramVector* vec = getProgramVector();
+      int pid = *(int*)params[0];
+      if(pid >= 0 && pid < vec->parameters_size){
+	automation.getSamples(pid, (float*)params[1], *(int*)params[2], vec->parameters[pid]);
+	ret = OWL_SERVICE_OK;
       }
     }
     break;
-  }
+  case OWL_SERVICE_LOG:
+    // expects a format string followed by pointers to up to four 32-bit arguments
+    if(len >= 1 && len <= DEFERRED_LOG_ARGS+1){
+      uint32_t args[DEFERRED_LOG_ARGS];
+      for(int i=1; i<len; ++i)
+	args[i-1] = *(uint32_t*)params[i];
+      debugLog.log((const char*)params[0], args, len-1);
+      ret = OWL_SERVICE_OK;
+    }
+    break;
+  case OWL_SERVICE_GET_ARRAY:
+    // expects name, &array and &size, repeated for each array
+    ret = SERVICE_GET_ARRAYS(params, len, true);
+    break;
+  case OWL_SERVICE_GET_ARRAY_BY_ID:
+    // expects &id, &array and &size, repeated for each array
+    ret = SERVICE_GET_ARRAYS(params, len, false);
+    break;
   }
   return ret;
 }     
@@ -3,12 +3,20 @@
 #define OWL_SERVICE_ARM_CFFT_INIT_F32      0x0110
 #define OWL_SERVICE_GET_PARAMETERS         0x1000
 #define OWL_SERVICE_GET_ARRAY              0x1010
+#define OWL_SERVICE_GET_ARRAY_BY_ID        0x1011
+#define OWL_SERVICE_GET_TEMPO              0x1020
+#define OWL_SERVICE_LOG                    0x1030
+#define OWL_SERVICE_GET_PARAMETER_SAMPLES  0x1040
 #define OWL_SERVICE_OK                     0x000
 #define OWL_SERVICE_INVALID_ARGS           -1
 
 #define SYSTEM_TABLE_LOG                   "SLG"
 #define SYSTEM_TABLE_POW                   "SPW"
 
+/* resource ids for OWL_SERVICE_GET_ARRAY_BY_ID */
+#define SYSTEM_TABLE_LOG_ID                0
+#define SYSTEM_TABLE_POW_ID                1
+
 #define OWL_SERVICE_VERSION                OWL_SERVICE_VERSION_V1
 
 #ifdef __cplusplus
@@ -0,0 +1,134 @@
+#include <string.h>
+#include "arm_math.h"
+#include "SignalMonitor.h"
+#include "Owl.h"
+#include "MidiController.h"
+#include "OpenWareMidiControl.h"
+#include "ApplicationSettings.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* below the program task: the monitor only runs while the program waits
+   for the next block, and never delays audio */
+#define MONITOR_TASK_PRIORITY   (1)
+#define MONITOR_TASK_STACK_SIZE (2048/sizeof(portSTACK_TYPE)) /* FFT and float formatting */
+
+static float fftbuffer[SIGNAL_MONITOR_SIZE];
+static float window[SIGNAL_MONITOR_SIZE];
+static arm_rfft_fast_instance_f32 fft;
+
+SignalMonitor::SignalMonitor() : mode(MONITOR_OFF), channel(MONITOR_INPUT_LEFT),
+				 decimation(1), interval(100), armed(false),
+				 captured(0), phase(0) {}
+
+static void runMonitorTask(void* p){
+  monitor.run();
+}
+
+void SignalMonitor::start(){
+  static StackType_t monitorStack[MONITOR_TASK_STACK_SIZE];
+  static StaticTask_t monitorTaskBuffer;
+  xTaskCreateStatic(runMonitorTask, "Monitor", MONITOR_TASK_STACK_SIZE, NULL,
+		    MONITOR_TASK_PRIORITY, monitorStack, &monitorTaskBuffer);
+}
+
+__attribute__ ((section (".coderam")))
+void SignalMonitor::record(int32_t* input, int32_t* output, uint16_t blocksize){
+  // with a 24 or 32 bit I2S data format each sample is stored as two
+  // swapped half words, the first holding the top 16 bits; with 16 bits
+  // it is one half word. The codec bit depth does not change this, since
+  // samples are msb aligned in the I2S frame.
+  uint8_t words = settings.audio_dataformat > 16 ? 2 : 1;
+  int16_t* src = (int16_t*)(channel < MONITOR_OUTPUT_LEFT ? input : output);
+  src += (channel & 1)*words;
+  uint16_t stride = 2*words; // half words per stereo frame
+  uint16_t pos = captured;
+  uint16_t i = phase;
+  while(i < blocksize && pos < SIGNAL_MONITOR_SIZE){
+    capture[pos++] = src[i*stride];
+    i += decimation;
+  }
+  phase = i - blocksize;
+  captured = pos;
+  if(pos == SIGNAL_MONITOR_SIZE)
+    armed = false;
+}
+
+void SignalMonitor::sendScope(){
+  static uint8_t buffer[4+SIGNAL_MONITOR_SCOPE_SIZE*2];
+  uint8_t* p = buffer;
+  *p++ = SYSEX_MONITOR;
+  *p++ = MONITOR_SCOPE;
+  *p++ = channel;
+  *p++ = decimation;
+  for(int i=0; i<SIGNAL_MONITOR_SCOPE_SIZE; ++i){
+    uint16_t value = (capture[i]+0x8000) >> 2;
+    *p++ = (value >> 7) & 0x7f;
+    *p++ = value & 0x7f;
+  }
+  midi.sendSysEx(buffer, sizeof(buffer));
+}
+
+void SignalMonitor::sendSpectrum(){
+  static uint8_t buffer[4+SIGNAL_MONITOR_SIZE/2];
+  for(int i=0; i<SIGNAL_MONITOR_SIZE; ++i)
+    fftbuffer[i] = capture[i]*window[i];
+  float* spectrum = fftbuffer+SIGNAL_MONITOR_SIZE/2; // reuse the input buffer for magnitudes
+  static float output[SIGNAL_MONITOR_SIZE];
+  arm_rfft_fast_f32(&fft, fftbuffer, output, 0);
+  output[1] = 0; // Nyquist bin, packed into the imaginary part of DC
+  arm_cmplx_mag_squared_f32(output, spectrum, SIGNAL_MONITOR_SIZE/2);
+  // a full scale sine peaks at N/4 with a Hann window
+  const float fullscale = 10*log10f(32768.0f*32768.0f*SIGNAL_MONITOR_SIZE*SIGNAL_MONITOR_SIZE/16);
+  uint8_t* p = buffer;
+  *p++ = SYSEX_MONITOR;
+  *p++ = MONITOR_SPECTRUM;
+  *p++ = channel;
+  *p++ = decimation;
+  for(int i=0; i<SIGNAL_MONITOR_SIZE/2; ++i){
+    float db = spectrum[i] > 0 ? 10*log10f(spectrum[i]) - fullscale : -1000.0f;
+    int value = 127 + (int)(db/SIGNAL_MONITOR_DB_STEP);
+    *p++ = max(0, min(127, value));
+  }
+  midi.sendSysEx(buffer, sizeof(buffer));
+}
+
+void SignalMonitor::run(){
+  arm_rfft_fast_init_f32(&fft, SIGNAL_MONITOR_SIZE);
+  for(int i=0; i<SIGNAL_MONITOR_SIZE; ++i)
+    window[i] = 0.5f - 0.5f*arm_cos_f32(2*PI*i/SIGNAL_MONITOR_SIZE);
+  for(;;){
+    if(mode == MONITOR_OFF){
+      vTaskDelay(pdMS_TO_TICKS(100));
+      continue;
+    }
+    captured = 0;
+    phase = 0;
+    armed = true;
+    while(armed)
+      vTaskDelay(1);
+    if(mode == MONITOR_SCOPE)
+      sendScope();
+    else if(mode == MONITOR_SPECTRUM)
+      sendSpectrum();
+    vTaskDelay(pdMS_TO_TICKS(interval));
+  }
+}
+
+void SignalMonitor::setMode(uint8_t value){
+  if(value <= MONITOR_SPECTRUM)
+    mode = (MonitorMode)value;
+}
+
+void SignalMonitor::setChannel(uint8_t value){
+  if(value <= MONITOR_OUTPUT_RIGHT)
+    channel = value;
+}
+
+void SignalMonitor::setDecimation(uint8_t value){
+  decimation = max(1, min(127, value));
+}
+
+void SignalMonitor::setInterval(uint16_t ms){
+  interval = max(SIGNAL_MONITOR_MIN_INTERVAL, ms);
+}
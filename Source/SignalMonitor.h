@@ -0,0 +1,67 @@
+#ifndef __SignalMonitor_h__
+#define __SignalMonitor_h__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SIGNAL_MONITOR_SIZE         256 /* samples per capture, the FFT length */
+#define SIGNAL_MONITOR_SCOPE_SIZE   128 /* samples per scope frame */
+#define SIGNAL_MONITOR_MIN_INTERVAL 20  /* ms between frames */
+#define SIGNAL_MONITOR_DB_STEP      0.75f /* spectrum resolution, 0 is -95.25dBFS or less */
+
+/*
+ * Streams what the device hears and plays to the host as SYSEX_MONITOR
+ * messages: either a decimated scope trace or a spectrum.
+ * The audio task only copies one channel of the current block into the
+ * capture buffer while a capture is armed, at most a few hundred cycles
+ * per block. The monitor task arms a capture, waits for it to fill, then
+ * windows it, runs the FFT and sends the frame over the non-blocking
+ * MIDI TX queue.
+ *
+ * Message body: mode, channel, decimation, followed by
+ * scope:    SIGNAL_MONITOR_SCOPE_SIZE samples of 14 bits, offset binary, msb first
+ * spectrum: SIGNAL_MONITOR_SIZE/2 magnitudes of 7 bits, in SIGNAL_MONITOR_DB_STEP steps
+ */
+class SignalMonitor {
+public:
+  enum MonitorMode {
+    MONITOR_OFF = 0,
+    MONITOR_SCOPE,
+    MONITOR_SPECTRUM
+  };
+  enum MonitorChannel {
+    MONITOR_INPUT_LEFT = 0,
+    MONITOR_INPUT_RIGHT,
+    MONITOR_OUTPUT_LEFT,
+    MONITOR_OUTPUT_RIGHT
+  };
+private:
+  volatile MonitorMode mode;
+  volatile uint8_t channel;
+  volatile uint8_t decimation;
+  volatile uint16_t interval;
+  volatile bool armed;
+  volatile uint16_t captured;
+  uint16_t phase; // samples to skip before the next capture, when decimating
+  int16_t capture[SIGNAL_MONITOR_SIZE];
+  void record(int32_t* input, int32_t* output, uint16_t blocksize);
+  void sendScope();
+  void sendSpectrum();
+public:
+  SignalMonitor();
+  void start();
+  void run();
+  void setMode(uint8_t value);
+  void setChannel(uint8_t value);
+  void setDecimation(uint8_t value);
+  void setInterval(uint16_t ms);
+  /* called from the audio task with the block just processed */
+  void process(int32_t* input, int32_t* output, uint16_t blocksize){
+    if(armed && input != NULL)
+      record(input, output, blocksize);
+  }
+};
+
+extern SignalMonitor monitor;
+
+#endif // __SignalMonitor_h__
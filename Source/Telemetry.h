@@ -0,0 +1,63 @@
+#ifndef __TELEMETRY_H
+#define __TELEMETRY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "sysex.h"
+#include "device.h"
+
+#define TELEMETRY_VERSION              2
+#define TELEMETRY_HISTOGRAM_BINS       8
+#define TELEMETRY_PARAMETERS           NOF_PARAMETERS
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+   /*
+    * Device status, sent as a SYSEX_TELEMETRY message: the frame is sent
+    * little-endian, 7-bit encoded with data_to_sysex().
+    * Fields are only ever added at the end, and the version is
+    * incremented when they are.
+    */
+   struct TelemetryFrame {
+     uint8_t version;
+     uint8_t error;               /* error status, 0 if none */
+     uint16_t cpu_load;           /* per mille of the block period, DEBUG_DWT only */
+     uint32_t timestamp;          /* ms since boot */
+     uint32_t cycles_per_block;   /* DEBUG_DWT only */
+     uint32_t heap_bytes_used;    /* by the program */
+     uint32_t program_stack_used; /* DEBUG_STACK only */
+     uint32_t free_heap;          /* firmware heap, DEBUG_STACK only */
+     uint32_t audio_overruns;     /* blocks not processed in time, since boot */
+     uint32_t midi_tx_dropped[2]; /* channel and sysex messages, since boot */
+     uint16_t cpu_histogram[TELEMETRY_HISTOGRAM_BINS]; /* blocks per eighth of the block period, since the last frame */
+     int16_t parameters[TELEMETRY_PARAMETERS];
+     uint32_t events_dropped;     /* button, note and parameter events, since boot. v2 */
+   };
+
+#define TELEMETRY_SYSEX_SIZE  ((sizeof(struct TelemetryFrame)*8+6)/7)
+
+   /*
+    * Decode the body of a SYSEX_TELEMETRY message, following the command
+    * byte. For host tools, build together with sysex.c.
+    * A frame of a newer version is decoded up to the fields known here.
+    * Returns 0 on success, -1 if the message is too short or of an older version.
+    */
+   static inline int telemetry_decode(const uint8_t* sysex, size_t len, struct TelemetryFrame* frame){
+     uint8_t data[sizeof(struct TelemetryFrame)+7];
+     if(len < TELEMETRY_SYSEX_SIZE)
+       return -1;
+     if(sysex_to_data(sysex, data, TELEMETRY_SYSEX_SIZE) < sizeof(struct TelemetryFrame) ||
+	data[0] < TELEMETRY_VERSION)
+       return -1;
+     memcpy(frame, data, sizeof(struct TelemetryFrame));
+     return 0;
+   }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TELEMETRY_H */
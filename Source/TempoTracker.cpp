@@ -0,0 +1,86 @@
+#include "TempoTracker.h"
+
+/*
+ * Loop coefficients b = sqrt(2)*w and c = w*w, for a bandwidth w in
+ * radians per event. MIDI clock comes often and with little jitter, so it
+ * is smoothed over many events. Taps are few and far apart, so the loop
+ * has to follow them quickly.
+ */
+#define CLOCK_LOOP_B   0.0707f /* w = 0.05 */
+#define CLOCK_LOOP_C   0.0025f
+#define TAP_LOOP_B     0.707f  /* w = 0.5 */
+#define TAP_LOOP_C     0.25f
+
+TempoTracker::TempoTracker() : source(TEMPO_NONE), last(0), next(0),
+			       period(0), count(0), events(0) {}
+
+void TempoTracker::update(uint32_t time, float b, float c){
+  int32_t gap = time - last;
+  if(events > 0 && (gap > TEMPO_TIMEOUT_US || (events > 1 && gap > 4*period))){
+    // events stopped and started again: find the tempo again
+    events = 0;
+  }
+  if(events == 0){
+    last = time;
+    events = 1;
+  }else if(events == 1){
+    period = time - last;
+    last = time;
+    next = time + period;
+    events = 2;
+  }else{
+    float e = (int32_t)(time - next);
+    last = next;
+    next += (int32_t)(period + b*e);
+    period += c*e;
+  }
+  count++;
+}
+
+/* called from the MIDI interrupt on every 0xF8 timing clock message */
+void TempoTracker::clock(uint32_t time){
+  if(source != TEMPO_CLOCK){
+    source = TEMPO_CLOCK;
+    events = 0;
+  }
+  update(time, CLOCK_LOOP_B, CLOCK_LOOP_C);
+}
+
+/* called on every tap tempo press */
+void TempoTracker::tap(uint32_t time){
+  if(source == TEMPO_CLOCK && (int32_t)(time - last) < TEMPO_TIMEOUT_US)
+    return; // MIDI clock is running
+  if(source != TEMPO_TAP){
+    source = TEMPO_TAP;
+    events = 0;
+    count = 0;
+  }
+  update(time, TAP_LOOP_B, TAP_LOOP_C);
+}
+
+/* MIDI start: the next clock is the first of a beat */
+void TempoTracker::start(){
+  count = 0;
+}
+
+float TempoTracker::getBeatsPerMinute(uint32_t now){
+  if(source == TEMPO_NONE || events < 2 || (int32_t)(now - last) > TEMPO_TIMEOUT_US)
+    return 0.0f;
+  float beat = source == TEMPO_CLOCK ? period*TEMPO_CLOCKS_PER_BEAT : period;
+  return 60000000.0f/beat;
+}
+
+/* position within the current beat, from 0 to 1 */
+float TempoTracker::getBeatPhase(uint32_t now){
+  if(getBeatsPerMinute(now) == 0.0f)
+    return 0.0f;
+  float elapsed = (int32_t)(now - last)/period;
+  if(elapsed > 1.0f)
+    elapsed = 1.0f; // hold until the next event arrives
+  if(source == TEMPO_CLOCK){
+    // count is one ahead: the clock at count 1 is the first of a beat
+    float phase = ((count+TEMPO_CLOCKS_PER_BEAT-1) % TEMPO_CLOCKS_PER_BEAT + elapsed)/TEMPO_CLOCKS_PER_BEAT;
+    return phase < 1.0f ? phase : 0.0f;
+  }
+  return elapsed < 1.0f ? elapsed : 0.0f;
+}
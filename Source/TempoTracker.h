@@ -0,0 +1,41 @@
+#ifndef __TempoTracker_h__
+#define __TempoTracker_h__
+
+#include <stdint.h>
+
+#define TEMPO_CLOCKS_PER_BEAT     24      /* MIDI clock */
+#define TEMPO_TIMEOUT_US          2000000 /* forget the tempo after this long without events */
+
+/*
+ * Estimates tempo and beat phase from timestamped MIDI clock messages and
+ * tap tempo presses. Each source is smoothed with a second order delay
+ * locked loop, which filters out timing jitter while following tempo
+ * changes. MIDI clock takes precedence over taps while it is running.
+ * Events are added from interrupts, and read from the audio task.
+ */
+class TempoTracker {
+private:
+  enum TempoSource {
+    TEMPO_NONE = 0,
+    TEMPO_TAP,
+    TEMPO_CLOCK
+  };
+  volatile TempoSource source;
+  volatile uint32_t last;    // filtered time of the last event, in us
+  volatile uint32_t next;    // predicted time of the next event
+  volatile float period;     // filtered time between events, in us
+  volatile uint32_t count;   // events since start, or since the tempo was found
+  uint32_t events;           // events counted so far while finding the tempo
+  void update(uint32_t time, float b, float c);
+public:
+  TempoTracker();
+  void clock(uint32_t time);
+  void tap(uint32_t time);
+  void start();
+  float getBeatsPerMinute(uint32_t now);
+  float getBeatPhase(uint32_t now);
+};
+
+extern TempoTracker tempo;
+
+#endif // __TempoTracker_h__
@@ -10,7 +10,6 @@
 #endif
 
    void adcSetupDMA(void* dma);
-   uint16_t getSampleCounter();
 
 #ifdef __cplusplus
 }
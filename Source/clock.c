@@ -27,3 +27,29 @@ void vApplicationTickHook(void) {
   /* systicks += portTICK_PERIOD_MS; */
 }
 #endif /* DEFINE_OWL_SYSTICK */
+
+/*
+ * Time since boot in microseconds, wrapping after 71 minutes.
+ * Interpolates between ticks with the SysTick counter, which counts down
+ * from its reload value once per 1ms tick.
+ * A pending SysTick interrupt means the counter has wrapped since the last
+ * tick was counted, however long the interrupt has been held off. The
+ * pending bit is read before the counter, and if it is set by the time
+ * the counter has been read, the counter is read again after the wrap.
+ */
+uint32_t getMicroseconds(){
+  uint32_t ms, val, pending;
+  do{
+    ms = systicks;
+    pending = SCB->ICSR & SCB_ICSR_PENDSTSET_Msk;
+    val = SysTick->VAL;
+    if(!pending && (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk)){
+      pending = 1;
+      val = SysTick->VAL; // wrapped while reading
+    }
+  }while(ms != systicks);
+  if(pending)
+    ms++; // the tick has not been handled yet
+  uint32_t load = SysTick->LOAD;
+  return ms*1000 + (load - val)*1000/(load+1);
+}
@@ -11,6 +11,7 @@
 
    void clockSetup();
    void delay(uint32_t ms);
+   uint32_t getMicroseconds();
 
 /* uint32_t getSysTicks(){ */
 /*   return systicks; */
@@ -42,6 +42,7 @@
 
 /* #include <sys/param.h> */
 /* #include <sys/systm.h> */
+#include <string.h>
 #include "crc32.h"
 
 static uint32_t crc32_tab[] = {
@@ -90,14 +91,147 @@ static uint32_t crc32_tab[] = {
   0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
 };
 
-uint32_t crc32(const void *buf, size_t size, uint32_t crc){
-  const uint8_t *p;
-
-  p = buf;
+static uint32_t crc32_bytes(const uint8_t *p, size_t size, uint32_t crc){
   crc = crc ^ ~0U;
-
   while (size--)
     crc = crc32_tab[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
-
   return crc ^ ~0U;
 }
+
+#ifdef ARM_CORTEX
+#include "stm32f4xx.h"
+
+/* number of words processed with interrupts disabled */
+#define CRC32_BLOCK_WORDS 256
+
+/*
+ * Word-wise crc32 using the CRC peripheral.
+ * The peripheral computes the non-reflected CRC-32/MPEG-2 (same polynomial,
+ * msb first, no final xor), so input and output words are bit reversed.
+ * Preloading the previous crc is done by xoring it into the first word after
+ * a reset, as suggested by mvduin on the STM32 forum. Each block runs with
+ * interrupts disabled, since the peripheral is shared with interrupt handlers.
+ */
+static uint32_t crc32_words(const uint32_t *p, size_t nwords, uint32_t crc){
+  RCC->AHB1ENR |= RCC_AHB1ENR_CRCEN;
+  while(nwords){
+    size_t n = nwords < CRC32_BLOCK_WORDS ? nwords : CRC32_BLOCK_WORDS;
+    nwords -= n;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    CRC->CR = CRC_CR_RESET;
+    CRC->DR = __RBIT(*p++ ^ crc);
+    while(--n)
+      CRC->DR = __RBIT(*p++);
+    crc = ~__RBIT(CRC->DR);
+    __set_PRIMASK(primask);
+  }
+  return crc;
+}
+
+/* as crc32_words, storing each word to dst on the way */
+static uint32_t crc32_copy_words(uint8_t *dst, const uint32_t *p, size_t nwords, uint32_t crc){
+  uint32_t word;
+  RCC->AHB1ENR |= RCC_AHB1ENR_CRCEN;
+  while(nwords){
+    size_t n = nwords < CRC32_BLOCK_WORDS ? nwords : CRC32_BLOCK_WORDS;
+    nwords -= n;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    CRC->CR = CRC_CR_RESET;
+    word = *p++;
+    memcpy(dst, &word, 4); /* dst may be unaligned */
+    dst += 4;
+    CRC->DR = __RBIT(word ^ crc);
+    while(--n){
+      word = *p++;
+      memcpy(dst, &word, 4);
+      dst += 4;
+      CRC->DR = __RBIT(word);
+    }
+    crc = ~__RBIT(CRC->DR);
+    __set_PRIMASK(primask);
+  }
+  return crc;
+}
+
+#else /* ARM_CORTEX */
+
+/* slice-by-8 fallback, tables are generated on first use */
+static uint32_t crc32_slices[8][256];
+static int crc32_slices_ready = 0;
+
+static void crc32_init_slices(void){
+  for(int i=0; i<256; ++i){
+    uint32_t crc = crc32_tab[i];
+    crc32_slices[0][i] = crc;
+    for(int j=1; j<8; ++j){
+      crc = crc32_tab[crc & 0xff] ^ (crc >> 8);
+      crc32_slices[j][i] = crc;
+    }
+  }
+  crc32_slices_ready = 1;
+}
+
+static uint32_t crc32_words(const uint32_t *p, size_t nwords, uint32_t crc){
+  if(!crc32_slices_ready)
+    crc32_init_slices();
+  crc = crc ^ ~0U;
+  for(; nwords >= 2; nwords -= 2){
+    uint32_t lo = *p++ ^ crc; /* assumes little endian */
+    uint32_t hi = *p++;
+    crc = crc32_slices[7][lo & 0xff] ^ crc32_slices[6][(lo >> 8) & 0xff] ^
+      crc32_slices[5][(lo >> 16) & 0xff] ^ crc32_slices[4][lo >> 24] ^
+      crc32_slices[3][hi & 0xff] ^ crc32_slices[2][(hi >> 8) & 0xff] ^
+      crc32_slices[1][(hi >> 16) & 0xff] ^ crc32_slices[0][hi >> 24];
+  }
+  crc = crc ^ ~0U;
+  if(nwords)
+    crc = crc32_bytes((const uint8_t*)p, 4, crc);
+  return crc;
+}
+
+static uint32_t crc32_copy_words(uint8_t *dst, const uint32_t *p, size_t nwords, uint32_t crc){
+  memcpy(dst, p, nwords << 2);
+  return crc32_words(p, nwords, crc);
+}
+
+#endif /* ARM_CORTEX */
+
+/* zlib compatible crc32, chained through the crc argument */
+uint32_t crc32(const void *buf, size_t size, uint32_t crc){
+  const uint8_t *p = buf;
+  if(size >= 8){
+    /* process 0-3 bytes to make pointer word aligned */
+    size_t align = -(uintptr_t)p & 3;
+    crc = crc32_bytes(p, align, crc);
+    p += align;
+    size -= align;
+    size_t nwords = size >> 2;
+    crc = crc32_words((const uint32_t*)p, nwords, crc);
+    p += nwords << 2;
+    size &= 3;
+  }
+  return crc32_bytes(p, size, crc);
+}
+
+/* copy size bytes from src to dst and return the crc32 of the data, in one pass */
+uint32_t crc32_copy(void *dst, const void *src, size_t size, uint32_t crc){
+  uint8_t *d = dst;
+  const uint8_t *p = src;
+  if(size >= 8){
+    size_t align = -(uintptr_t)p & 3;
+    memcpy(d, p, align);
+    crc = crc32_bytes(p, align, crc);
+    p += align;
+    d += align;
+    size -= align;
+    size_t nwords = size >> 2;
+    crc = crc32_copy_words(d, (const uint32_t*)p, nwords, crc);
+    p += nwords << 2;
+    d += nwords << 2;
+    size &= 3;
+  }
+  memcpy(d, p, size);
+  return crc32_bytes(p, size, crc);
+}
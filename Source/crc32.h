@@ -9,6 +9,7 @@
 #endif
 
    uint32_t crc32(const void *buf, size_t size, uint32_t crc);
+   uint32_t crc32_copy(void *dst, const void *src, size_t size, uint32_t crc);
 
 #ifdef __cplusplus
 }
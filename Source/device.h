@@ -53,6 +53,7 @@
 
 #define MIDI_CHANNEL                 0
 #define MIDI_MAX_MESSAGE_SIZE        256
+#define MIDI_PARAMETER_INTERVAL      10  /* ms between outgoing parameter updates */
 #define NOF_ADC_VALUES               5
 #define NOF_PARAMETERS               40
 #define NOF_BUTTONS                  5
@@ -61,7 +62,7 @@
 #define MAX_SYSEX_PROGRAM_SIZE       (128*1024) // 128k, one flash sector
 
 #define MAX_FACTORY_PATCHES          36
-#define MAX_USER_PATCHES             4
+#define MAX_USER_PATCHES             16 // stored in FLASH sectors 8-11
 #define MAX_NUMBER_OF_PATCHES        (MAX_FACTORY_PATCHES+MAX_USER_PATCHES+1)
 
 /* I2C clock speed configuration (in Hz)  */
@@ -64,18 +64,17 @@ int eeprom_write_block(uint32_t address, void* data, uint32_t size){
   volatile uint32_t* dest = (volatile uint32_t*)address;
   uint32_t* src = (uint32_t*)data;
   FLASH_Status status = eeprom_wait();
-  for(uint32_t i=0; i<size && status == FLASH_COMPLETE; i+=4){
-    /* when the previous operation is completed, proceed to program the new data */
+  if(status == FLASH_COMPLETE){
+    /* x32 is the widest parallelism at 2.7-3.6V without external Vpp.
+       PG stays set for the whole block, with one wait per word. */
     FLASH->CR &= CR_PSIZE_MASK;
     FLASH->CR |= FLASH_PSIZE_WORD;
     FLASH->CR |= FLASH_CR_PG;
-    *dest++ = *src++;
-    /* Wait for last operation to be completed */
-    status = eeprom_wait();
-    /* if the program operation is completed, disable the PG Bit */
+    for(uint32_t i=0; i<size && status == FLASH_COMPLETE; i+=4){
+      *dest++ = *src++;
+      status = eeprom_wait();
+    }
     FLASH->CR &= (~FLASH_CR_PG);
-    /* Wait for last operation to be completed */
-    status = eeprom_wait();
   }
   return status == FLASH_COMPLETE ? 0 : -1;
 }
@@ -0,0 +1,85 @@
+#include "flashupdate.h"
+#include "eepromcontrol.h"
+#include <string.h>
+
+#define FLASH_ERASED_WORD ((uint32_t)0xffffffff)
+#define FLASH_FOOTER_MAGIC ((uint32_t)0xDADAF00D)
+
+typedef struct {
+  uint32_t size;
+  uint32_t crc;
+  uint32_t magic;
+} FlashFooter;
+
+/*
+ * Make a flash sector of length bytes hold size bytes of data, followed by
+ * erased flash up to the end of the sector. The sector is only erased and
+ * programmed if its contents differ. A trailing partial word of data is
+ * padded with 0xff.
+ * Runs from RAM, so that it can update the sectors the firmware runs from.
+ * Flash must be unlocked. Data must be word aligned.
+ * Returns 1 if the sector was programmed, 0 if it was unchanged, -1 on error.
+ */
+__attribute__ ((section (".coderam")))
+int flash_update_sector(uint32_t sector, uint32_t address, uint32_t length,
+			const uint8_t* data, uint32_t size){
+  const uint32_t* dest = (const uint32_t*)address;
+  const uint32_t* src = (const uint32_t*)data;
+  uint32_t words = size/4;
+  uint32_t tail = FLASH_ERASED_WORD;
+  for(uint32_t i=0; i<(size&3); ++i)
+    tail ^= (uint32_t)(data[words*4+i] ^ 0xff) << (i*8); /* little endian */
+  uint32_t i = 0;
+  while(i < words && dest[i] == src[i])
+    i++;
+  int same = i == words;
+  if(same && (size&3))
+    same = dest[i++] == tail;
+  while(same && i < length/4)
+    same = dest[i++] == FLASH_ERASED_WORD;
+  if(same)
+    return 0;
+  if(eeprom_erase_sector(sector) != 0)
+    return -1;
+  if(eeprom_write_block(address, (void*)data, words*4) != 0)
+    return -1;
+  if((size&3) && eeprom_write_block(address+words*4, &tail, 4) != 0)
+    return -1;
+  return 1;
+}
+
+/*
+ * Append a footer with the size and checksum of an image to the image
+ * data, at the next word boundary, so that the image can later be read
+ * back exactly. The buffer must have room for 3 more words.
+ * Returns the size of the image with its footer.
+ */
+uint32_t flash_append_footer(uint8_t* data, uint32_t size, uint32_t crc){
+  FlashFooter footer = { size, crc, FLASH_FOOTER_MAGIC };
+  uint32_t end = (size+3) & ~3;
+  memset(data+size, 0xff, end-size);
+  memcpy(data+end, &footer, sizeof(footer));
+  return end+sizeof(footer);
+}
+
+/*
+ * Find the footer of an image that was stored with flash_update_sector,
+ * and so is followed only by erased flash, in length bytes from address.
+ * Returns 0 and sets size and crc if a valid footer was found, else -1.
+ */
+int flash_find_footer(uint32_t address, uint32_t length,
+		      uint32_t* size, uint32_t* crc){
+  const uint32_t* start = (const uint32_t*)address;
+  const uint32_t* end = start + length/4;
+  while(end > start && end[-1] == FLASH_ERASED_WORD)
+    end--;
+  if(end - start < 3)
+    return -1;
+  const FlashFooter* footer = (const FlashFooter*)(end - 3);
+  if(footer->magic != FLASH_FOOTER_MAGIC ||
+     ((footer->size+3) & ~3) != (uint32_t)((const uint8_t*)footer - (const uint8_t*)start))
+    return -1;
+  *size = footer->size;
+  *crc = footer->crc;
+  return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef __FLASH_UPDATE_H
+#define __FLASH_UPDATE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+   int flash_update_sector(uint32_t sector, uint32_t address, uint32_t length,
+			   const uint8_t* data, uint32_t size);
+   uint32_t flash_append_footer(uint8_t* data, uint32_t size, uint32_t crc);
+   int flash_find_footer(uint32_t address, uint32_t length,
+			 uint32_t* size, uint32_t* crc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FLASH_UPDATE_H */
@@ -6,6 +6,8 @@
 int16_t *txbuf;
 int16_t *rxbuf;
 uint16_t szbuf;
+static uint16_t blocksz;
+static volatile uint32_t dmaBlocks; /* completed half buffer transfers */
 
 void I2S_Pause(){
   /* Pause the I2S DMA Stream 
@@ -33,6 +35,8 @@ void I2S_Block_Init(int16_t *tx, int16_t *rx, uint16_t blocksize){
   /* save for IRQ svc  */
   txbuf = tx;
   rxbuf = rx;
+  blocksz = blocksize;
+  dmaBlocks = 0;
   /* szbuf is the size in halfwords of one block; half of the buffer */
 #if AUDIO_BITDEPTH == 16
   szbuf = blocksize*AUDIO_CHANNELS;
@@ -124,6 +128,25 @@ void I2S_Enable(){
   }
 }
 
+/*
+ * Samples received since the audio DMA was started, from the block
+ * counter and the position of the RX DMA stream in the ring buffer.
+ */
+__attribute__ ((section (".coderam")))
+uint32_t getSampleClock(){
+  uint32_t blocks, remaining;
+  do{
+    blocks = dmaBlocks;
+    remaining = DMA_GetCurrDataCounter(AUDIO_I2S_EXT_DMA_STREAM);
+  }while(blocks != dmaBlocks);
+  return sampleClockFromDma(blocks, remaining, szbuf, blocksz);
+}
+
+/* first sample of the last completed block, the one the program processes next */
+uint32_t getBlockSampleClock(){
+  return (dmaBlocks-1)*blocksz;
+}
+
 /**
  * handle I2S RX DMA block interrupts
  */
@@ -132,12 +155,14 @@ void DMA1_Stream3_IRQHandler(void){
   if(DMA_GetFlagStatus(AUDIO_I2S_EXT_DMA_STREAM, AUDIO_I2S_EXT_DMA_FLAG_TC) != RESET) {
     /* Transfer complete interrupt */
     /* Handle 2nd half */
+    dmaBlocks++;
     audioCallback(rxbuf + szbuf, txbuf + szbuf);
     /* Clear the Interrupt flag */
     DMA_ClearFlag(AUDIO_I2S_EXT_DMA_STREAM, AUDIO_I2S_EXT_DMA_FLAG_TC);
   }else if (DMA_GetFlagStatus(AUDIO_I2S_EXT_DMA_STREAM, AUDIO_I2S_EXT_DMA_FLAG_HT) != RESET) {
     /* Half Transfer complete interrupt */
     /* Handle 1st half */
+    dmaBlocks++;
     audioCallback(rxbuf, txbuf);
     /* Clear the Interrupt flag */
     DMA_ClearFlag(AUDIO_I2S_EXT_DMA_STREAM, AUDIO_I2S_EXT_DMA_FLAG_HT);
@@ -13,8 +13,26 @@
    void I2S_Pause();
    void I2S_Resume();
    void I2S_Disable();
+   uint32_t getSampleClock();
+   uint32_t getBlockSampleClock();
    extern void audioCallback(int16_t *src, int16_t *dst);
 
+   /*
+    * Sample clock from the count of block interrupts handled and the
+    * remaining count of a DMA stream over a ring of two blocks of szbuf
+    * halfwords. The count may lag behind when the block interrupt is
+    * pending: the half of the ring the DMA is in tells whether it has
+    * been counted.
+    */
+   static inline uint32_t sampleClockFromDma(uint32_t blocks, uint32_t remaining,
+					     uint16_t szbuf, uint16_t blocksz){
+     uint32_t pos = szbuf*2 - remaining; /* halfwords into the ring */
+     uint32_t half = pos >= szbuf;
+     if(half != (blocks & 1))
+       blocks++; /* the interrupt for the last block is pending */
+     return blocks*blocksz + (pos - half*szbuf)*blocksz/szbuf;
+   }
+
 #ifdef __cplusplus
 }
 #endif
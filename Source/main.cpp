@@ -5,6 +5,7 @@
 #include "owlcontrol.h"
 
 #include "ProgramManager.h"
+#include "SignalMonitor.h"
 
 extern "C" {
   void vApplicationMallocFailedHook(void) {
@@ -45,6 +46,7 @@ int main(void){
 #endif
 
   program.startManager(); // start the program manager task
+  monitor.start(); // start the signal monitor task
 
   vTaskStartScheduler();  // should never return
   for (;;);
@@ -7,19 +7,26 @@
 #include <string.h>
 
 extern USB_OTG_CORE_HANDLE           USB_OTG_dev;
-/* These are external variables imported from USB-MIDI core to be used for IN
-   transfer management. It is extremely similar in structure to USB CDC-class
-   devices since both use bulk endpoints to transfer serial data. */
-extern uint8_t  APP_Rx_Buffer []; /* Write MIDI received data in this buffer.
-                                     These data will be sent over USB IN endpoint
-                                     in the MIDI core functions. */
-extern volatile uint32_t APP_Rx_ptr_in;    /* Increment this pointer or roll it back to
-                                     start address when writing received data
-                                     in the buffer APP_Rx_Buffer. */
-extern volatile uint32_t APP_Rx_ptr_out;   /* This pointer is used by the MIDI driver to
-                                     manage data it's sent. We need to keep track
-                                     of it to ensure we don't write over data that
-                                     has yet to be sent. */
+
+/*
+ * Transmit queue of 4-byte USB-MIDI packets, filled from tasks and
+ * interrupts and drained by the USB SOF and IN callbacks.
+ * A producer reserves a run of slots by moving the head with a
+ * compare-and-swap, then writes its packets into them. An empty slot holds
+ * zero, so the consumer stops at a packet that is reserved but not yet
+ * written, and clears each slot before moving the tail past it.
+ * Producers never wait: when there is no room the message is dropped
+ * and counted.
+ */
+#define MIDI_TX_QUEUE_SIZE      (APP_RX_DATA_SIZE/4) /* packets, a power of two */
+#define MIDI_TX_QUEUE_MASK      (MIDI_TX_QUEUE_SIZE-1)
+#define MIDI_TX_CHANNEL_RESERVE 32   /* packets sysex may not use */
+#define MIDI_TX_STALL_LIMIT     1000 /* consumer calls before an unwritten slot is skipped */
+
+static volatile uint32_t tx_queue[MIDI_TX_QUEUE_SIZE];
+static volatile uint32_t tx_head = 0;
+static volatile uint32_t tx_tail = 0;
+static volatile uint32_t tx_dropped[MIDI_TX_CLASSES];
 
 /* status flag that is set when the USB device is connected */
 extern uint8_t usbd_usr_device_status;
@@ -29,18 +36,8 @@ bool midi_device_connected(){
   return usbd_usr_device_status > 0x02;
 }
 
-void midi_receive_usb_buffer(uint8_t *buffer, uint16_t length){    
-  for(int i=1; i<length; ++i){
-    // skip every 4th byte
-    if(i & 0x3){
-      MidiReaderStatus status = handler.read(buffer[i]);
-      if(status == ERROR_STATUS){
-	handler.clear();
-	// todo: error message
-	return; // discard the rest of the message
-      }
-    }
-  }
+void midi_receive_usb_buffer(uint8_t *buffer, uint16_t length){
+  handler.readPackets(buffer, length);
 }
 
 // void midi_send_short_message(uint8_t* msg, uint16_t length) {
@@ -60,22 +57,115 @@ void midi_receive_usb_buffer(uint8_t *buffer, uint16_t length){
 //   midi_send_usb_buffer(packet, sizeof(packet));
 // }
 
-void midi_send_usb_buffer(uint8_t* buffer, uint16_t length) {
-  /* Add a MIDI message to the USB buffer. These need to be written in
-   * discrete chunks of 4 bytes, because the host can produce unexpected behaviour
-   * if a USB transaction comes in which contains only part of a MIDI packet (e.g. if
-   * a start-of-frame request happens to fall within the loop of copying the packet
-   * byte-by-byte). One consequence of this is that the USB buffer size must be a multiple
-   * of 4 (the packet size).
-   */
+bool midi_tx_reserve(uint16_t packets, MidiTxClass cls, uint32_t* pos){
   /* Check if device is online */
   if(USB_OTG_dev.dev.device_status != USB_OTG_CONFIGURED)
-    return;
-  /* If the buffer is completely full, wait until the USB peripheral clears
-   * it to continue. */
-  while((APP_RX_DATA_SIZE + APP_Rx_ptr_out - APP_Rx_ptr_in) % APP_RX_DATA_SIZE == length);
-  memcpy(&APP_Rx_Buffer[APP_Rx_ptr_in], buffer, length);
-  APP_Rx_ptr_in += length;
-  if(APP_Rx_ptr_in >= APP_RX_DATA_SIZE)
-    APP_Rx_ptr_in = 0;
+    return false;
+  uint32_t limit = MIDI_TX_QUEUE_SIZE;
+  if(cls == MIDI_TX_SYSEX)
+    limit -= MIDI_TX_CHANNEL_RESERVE;
+  uint32_t head;
+  do{
+    head = tx_head;
+    if(head - tx_tail + packets > limit){
+      __sync_fetch_and_add(&tx_dropped[cls], 1);
+      return false;
+    }
+  }while(!__sync_bool_compare_and_swap(&tx_head, head, head+packets));
+  *pos = head;
+  return true;
+}
+
+/*
+ * write one packet to a reserved slot, which makes it visible to the consumer.
+ * The packet is dropped if the consumer has given up on the slot and moved
+ * the tail past it, so that a late write can not turn up in a later use of
+ * the slot. Positions count up without wrapping the queue, so the tail
+ * position tells which use of the slot is current.
+ */
+void midi_tx_write(uint32_t pos, uint8_t* packet){
+  uint32_t word;
+  memcpy(&word, packet, 4);
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if((int32_t)(pos - tx_tail) >= 0)
+    tx_queue[pos & MIDI_TX_QUEUE_MASK] = word;
+  __set_PRIMASK(primask);
+}
+
+bool midi_send_usb_buffer(uint8_t* buffer, uint16_t length) {
+  /* Add channel messages to the USB buffer. These need to be written in
+   * discrete chunks of 4 bytes, because the host can produce unexpected behaviour
+   * if a USB transaction comes in which contains only part of a MIDI packet.
+   * The whole buffer is queued, or dropped if it does not fit.
+   * Returns false if it was dropped.
+   */
+  uint32_t pos;
+  if(!midi_tx_reserve(length/4, MIDI_TX_CHANNEL, &pos))
+    return false;
+  for(uint16_t i=0; i<length; i+=4)
+    midi_tx_write(pos++, buffer+i);
+  return true;
+}
+
+/*
+ * Move packets from the queue to a USB transfer buffer, called only from
+ * the USB interrupt. Returns the number of bytes copied.
+ * A slot that stays unwritten for long, because its producer was deleted
+ * while sending, is skipped so that the queue does not stall for good.
+ * The new tail is published before the lock is released, so that
+ * midi_tx_write sees the slot as skipped.
+ */
+uint16_t midi_tx_pull(uint8_t* buffer, uint16_t size){
+  static uint32_t stalled = 0;
+  uint32_t tail = tx_tail;
+  uint16_t len = 0;
+  while(len+4 <= size && tail != tx_head){
+    uint32_t word = tx_queue[tail & MIDI_TX_QUEUE_MASK];
+    if(word == 0){
+      if(len > 0 || ++stalled < MIDI_TX_STALL_LIMIT)
+	break;
+      // skip the slot, unless its packet has just been written
+      uint32_t primask = __get_PRIMASK();
+      __disable_irq();
+      if(tx_queue[tail & MIDI_TX_QUEUE_MASK] == 0)
+	tx_tail = ++tail;
+      __set_PRIMASK(primask);
+      continue;
+    }
+    tx_queue[tail & MIDI_TX_QUEUE_MASK] = 0;
+    memcpy(buffer+len, &word, 4);
+    len += 4;
+    tail++;
+    stalled = 0;
+  }
+  if(tail == tx_head)
+    stalled = 0;
+  tx_tail = tail;
+  return len;
+}
+
+uint32_t midi_tx_dropped(MidiTxClass cls){
+  return tx_dropped[cls];
+}
+
+/* number of bytes of sysex that can be queued without being dropped */
+uint16_t midi_usb_buffer_space(){
+  uint32_t used = tx_head - tx_tail;
+  uint32_t limit = MIDI_TX_QUEUE_SIZE - MIDI_TX_CHANNEL_RESERVE;
+  return used < limit ? (limit - used)*4 : 0;
+}
+
+/* called on every USB start of frame, once per millisecond */
+void midi_usb_frame(){
+  static uint32_t frames = 0;
+  static uint32_t telemetry = 0;
+  if(++frames >= settings.midi_parameter_interval){
+    frames = 0;
+    midi.sendParameterValues();
+  }
+  if(midi.getTelemetryInterval() && ++telemetry >= midi.getTelemetryInterval()){
+    telemetry = 0;
+    program.sendTelemetryFromISR();
+  }
 }
@@ -8,8 +8,21 @@
  extern "C" {
 #endif
 
+   /* message classes, each with its own drop policy when the transmit queue is full */
+   typedef enum {
+     MIDI_TX_CHANNEL = 0, /* channel messages: may use the whole queue */
+     MIDI_TX_SYSEX,       /* sysex: leaves room for channel messages, dropped whole */
+     MIDI_TX_CLASSES
+   } MidiTxClass;
+
    void midi_receive_usb_buffer(uint8_t *buffer, uint16_t length);
-   void midi_send_usb_buffer(uint8_t* buffer, uint16_t length);
+   bool midi_send_usb_buffer(uint8_t* buffer, uint16_t length);
+   bool midi_tx_reserve(uint16_t packets, MidiTxClass cls, uint32_t* pos);
+   void midi_tx_write(uint32_t pos, uint8_t* packet);
+   uint16_t midi_tx_pull(uint8_t* buffer, uint16_t size);
+   uint32_t midi_tx_dropped(MidiTxClass cls);
+   uint16_t midi_usb_buffer_space();
+   void midi_usb_frame();
    bool midi_device_connected();
 
 #ifdef __cplusplus
@@ -1,40 +1,65 @@
+#include <string.h>
 #include "sysex.h"
 
 /* convert to/from sysex 7-bit data 
- * taken from http://blogs.bl0rg.net/netzstaub/2008/08/14/encoding-8-bit-data-in-midi-sysex/
+ * format from http://blogs.bl0rg.net/netzstaub/2008/08/14/encoding-8-bit-data-in-midi-sysex/
+ * Every 7 bytes of data are sent as 8 bytes of sysex: one byte with the
+ * msbs of the following 7 bytes (lsb first), then the 7 bytes with their
+ * msb cleared. A trailing group of n < 7 bytes takes n+1 bytes of sysex.
+ * Whole groups are processed as one 32-bit and one 24-bit word.
  */
-uint8_t data_to_sysex(uint8_t *data, uint8_t *sysex, uint8_t len) {
-  uint8_t retlen = 0;
-  uint8_t cnt;
-  uint8_t cnt7 = 0;
-
-  sysex[0] = 0;
-  for(cnt = 0; cnt < len; cnt++) {
-    uint8_t c = data[cnt] & 0x7F;
-    uint8_t msb = data[cnt] >> 7;
-    sysex[0] |= msb << cnt7;
-    sysex[1 + cnt7] = c;
-    if(cnt7++ == 6) {
-      sysex += 8;
-      retlen += 8;
-      sysex[0] = 0;
-      cnt7 = 0;
+size_t data_to_sysex(const uint8_t *data, uint8_t *sysex, size_t len) {
+  size_t retlen = 0;
+  uint32_t lo, hi;
+  while(len >= 7){
+    memcpy(&lo, data, 4); /* unaligned word access */
+    hi = data[4] | (data[5] << 8) | (data[6] << 16);
+    sysex[0] = ((lo >> 7) & 0x01) | ((lo >> 14) & 0x02) | ((lo >> 21) & 0x04) | ((lo >> 28) & 0x08) |
+      ((hi >> 3) & 0x10) | ((hi >> 10) & 0x20) | ((hi >> 17) & 0x40);
+    lo &= 0x7f7f7f7f;
+    memcpy(sysex+1, &lo, 4);
+    sysex[5] = hi & 0x7f;
+    sysex[6] = (hi >> 8) & 0x7f;
+    sysex[7] = (hi >> 16) & 0x7f;
+    data += 7;
+    sysex += 8;
+    retlen += 8;
+    len -= 7;
+  }
+  if(len > 0){
+    uint8_t msb = 0;
+    for(size_t i=0; i<len; ++i){
+      msb |= (data[i] >> 7) << i;
+      sysex[i+1] = data[i] & 0x7f;
     }
+    sysex[0] = msb;
+    retlen += len+1;
   }
-  return retlen + cnt7 + (cnt7 != 0 ? 1 : 0);
+  return retlen;
 }
 
-uint8_t sysex_to_data(uint8_t *sysex, uint8_t *data, uint8_t len) {
-  uint8_t cnt;
-  uint8_t cnt2 = 0;
-  uint8_t bits = 0;
-  for(cnt = 0; cnt < len; cnt++) {
-    if((cnt % 8) == 0) {
-      bits = sysex[cnt];
-    }else{
-      data[cnt2++] = sysex[cnt] | ((bits & 1) << 7);
-      bits >>= 1;
-    }
+size_t sysex_to_data(const uint8_t *sysex, uint8_t *data, size_t len) {
+  size_t retlen = 0;
+  uint32_t msb, lo, hi;
+  while(len >= 8){
+    msb = sysex[0];
+    memcpy(&lo, sysex+1, 4); /* unaligned word access */
+    lo |= ((msb & 0x01) << 7) | ((msb & 0x02) << 14) | ((msb & 0x04) << 21) | ((msb & 0x08) << 28);
+    hi = ((msb & 0x10) << 3) | ((msb & 0x20) << 10) | ((msb & 0x40) << 17);
+    memcpy(data, &lo, 4);
+    data[4] = sysex[5] | hi;
+    data[5] = sysex[6] | (hi >> 8);
+    data[6] = sysex[7] | (hi >> 16);
+    sysex += 8;
+    data += 7;
+    retlen += 7;
+    len -= 8;
+  }
+  if(len > 1){
+    msb = sysex[0];
+    for(size_t i=1; i<len; ++i)
+      data[i-1] = sysex[i] | (((msb >> (i-1)) & 1) << 7);
+    retlen += len-1;
   }
-  return cnt2;
+  return retlen;
 }
@@ -33,11 +33,8 @@ static uint8_t usbd_audio_CfgDesc[AUDIO_CONFIG_DESC_SIZE];
 
 __ALIGN_BEGIN uint8_t USB_Rx_Buffer   [MIDI_MAX_PACKET_SIZE] __ALIGN_END ;
 
-__ALIGN_BEGIN uint8_t APP_Rx_Buffer   [APP_RX_DATA_SIZE] __ALIGN_END ;
-
-volatile uint32_t APP_Rx_ptr_in  = 0;
-volatile uint32_t APP_Rx_ptr_out = 0;
-volatile uint32_t APP_Rx_length  = 0;
+/* packets taken from the MIDI transmit queue for the current IN transfer */
+__ALIGN_BEGIN uint8_t USB_Tx_Buffer   [MIDI_MAX_PACKET_SIZE] __ALIGN_END ;
 
 uint8_t  USB_Tx_State = 0;
 
@@ -368,37 +365,21 @@ static uint8_t  usbd_audio_EP0_RxReady (void  *pdev)
   */
 static uint8_t  usbd_audio_DataIn (void *pdev, uint8_t epnum)
 {
-	uint16_t USB_Tx_ptr;
 	uint16_t USB_Tx_length;
 
 	if (USB_Tx_State == 1)
 	{
-		if (APP_Rx_length == 0)
+		USB_Tx_length = midi_tx_pull(USB_Tx_Buffer, MIDI_MAX_PACKET_SIZE);
+		if (USB_Tx_length == 0)
 		{
 		  USB_Tx_State = 0;
 		}
 		else
 		{
-		  if (APP_Rx_length > MIDI_MAX_PACKET_SIZE){
-			USB_Tx_ptr = APP_Rx_ptr_out;
-			USB_Tx_length = MIDI_MAX_PACKET_SIZE;
-
-			APP_Rx_ptr_out += MIDI_MAX_PACKET_SIZE;
-			APP_Rx_length -= MIDI_MAX_PACKET_SIZE;
-		  }
-		  else
-		  {
-			USB_Tx_ptr = APP_Rx_ptr_out;
-			USB_Tx_length = APP_Rx_length;
-
-			APP_Rx_ptr_out += APP_Rx_length;
-			APP_Rx_length = 0;
-		  }
-
 		  /* Prepare the available data buffer to be sent on IN endpoint */
 		  DCD_EP_Tx (pdev,
 					 AUDIO_IN_EP,
-					 (uint8_t*)&APP_Rx_Buffer[USB_Tx_ptr],
+					 USB_Tx_Buffer,
 					 USB_Tx_length);
 		}
 	}
@@ -447,6 +428,8 @@ static uint8_t  usbd_audio_SOF (void *pdev)
 {     
 	static uint32_t FrameCount = 0;
 
+	midi_usb_frame();
+
 	if (++FrameCount == MIDI_IN_FRAME_INTERVAL)
 	{
 		/* Reset the frame counter */
@@ -468,55 +451,21 @@ static uint8_t  usbd_audio_SOF (void *pdev)
   */
 static void Handle_USBAsynchXfer (void *pdev)
 {
-  uint16_t USB_Tx_ptr;
   uint16_t USB_Tx_length;
 
   if(USB_Tx_State != 1)
   {
-    if (APP_Rx_ptr_out == APP_RX_DATA_SIZE)
-    {
-      APP_Rx_ptr_out = 0;
-    }
-
-    if(APP_Rx_ptr_out == APP_Rx_ptr_in)
+    USB_Tx_length = midi_tx_pull(USB_Tx_Buffer, MIDI_MAX_PACKET_SIZE);
+    if(USB_Tx_length == 0)
     {
       USB_Tx_State = 0;
       return;
     }
-
-    if(APP_Rx_ptr_out > APP_Rx_ptr_in) /* rollback */
-    {
-      APP_Rx_length = APP_RX_DATA_SIZE - APP_Rx_ptr_out;
-    }
-    else
-    {
-      APP_Rx_length = APP_Rx_ptr_in - APP_Rx_ptr_out;
-    }
-#ifdef USB_OTG_HS_INTERNAL_DMA_ENABLED
-     APP_Rx_length &= ~0x03;
-#endif /* USB_OTG_HS_INTERNAL_DMA_ENABLED */
-
-    if (APP_Rx_length > MIDI_MAX_PACKET_SIZE)
-    {
-      USB_Tx_ptr = APP_Rx_ptr_out;
-      USB_Tx_length = MIDI_MAX_PACKET_SIZE;
-
-      APP_Rx_ptr_out += MIDI_MAX_PACKET_SIZE;
-      APP_Rx_length -= MIDI_MAX_PACKET_SIZE;
-    }
-    else
-    {
-      USB_Tx_ptr = APP_Rx_ptr_out;
-      USB_Tx_length = APP_Rx_length;
-
-      APP_Rx_ptr_out += APP_Rx_length;
-      APP_Rx_length = 0;
-    }
     USB_Tx_State = 1;
 
     DCD_EP_Tx (pdev,
                AUDIO_IN_EP,
-               (uint8_t*)&APP_Rx_Buffer[USB_Tx_ptr],
+               USB_Tx_Buffer,
                USB_Tx_length);
   }
 
@@ -0,0 +1,100 @@
+#include <string.h>
+#include "Test.h"
+#include "SimulatedFlash.h"
+#include "ApplicationSettings.h"
+#include "device.h"
+
+#define SETTINGS_SECTOR_SIZE (16*1024)
+
+ApplicationSettings settings;
+
+static void testDefaults(){
+  SimulatedFlash flash(1, SETTINGS_SECTOR_SIZE);
+  ApplicationSettings s;
+  s.init(flash, flash.getAddress());
+  CHECK(!s.settingsInFlash());
+  CHECK_EQUAL(s.audio_blocksize, AUDIO_BLOCK_SIZE);
+  CHECK_EQUAL(s.program_index, DEFAULT_PROGRAM);
+}
+
+static void testSaveAndLoad(){
+  SimulatedFlash flash(1, SETTINGS_SECTOR_SIZE);
+  ApplicationSettings s;
+  s.init(flash, flash.getAddress());
+  s.program_index = 7;
+  s.audio_blocksize = 64;
+  s.saveToFlash();
+  CHECK(s.settingsInFlash());
+  ApplicationSettings loaded;
+  loaded.init(flash, flash.getAddress());
+  CHECK_EQUAL(loaded.program_index, 7);
+  CHECK_EQUAL(loaded.audio_blocksize, 64);
+  // saving unchanged settings programs nothing
+  int words = flash.words;
+  loaded.saveToFlash();
+  CHECK_EQUAL(flash.words, words);
+  CHECK_EQUAL(flash.erases, 0);
+  CHECK_EQUAL(flash.errors, 0);
+}
+
+static void testWearLevelling(){
+  SimulatedFlash flash(1, SETTINGS_SECTOR_SIZE);
+  ApplicationSettings s;
+  s.init(flash, flash.getAddress());
+  const int records = SETTINGS_SECTOR_SIZE/((sizeof(ApplicationSettings)+3) & ~3);
+  for(int i=0; i<records; ++i){
+    s.program_index = i & 0x7f;
+    s.inputGainLeft = i >> 7;
+    s.saveToFlash();
+  }
+  // the sector holds exactly one record per save
+  CHECK_EQUAL(flash.erases, 0);
+  s.program_index = 99;
+  s.saveToFlash();
+  CHECK_EQUAL(flash.erases, 1);
+  ApplicationSettings loaded;
+  loaded.init(flash, flash.getAddress());
+  CHECK_EQUAL(loaded.program_index, 99);
+  CHECK_EQUAL(flash.errors, 0);
+}
+
+/* cut the power at every flash operation of a save: the previous settings survive a torn record */
+static void testInterruptedSave(){
+  for(int cut=0; cut<3; ++cut){
+    SimulatedFlash flash(1, SETTINGS_SECTOR_SIZE);
+    ApplicationSettings s;
+    s.init(flash, flash.getAddress());
+    s.program_index = 3;
+    s.saveToFlash();
+    s.program_index = 4;
+    flash.failAfter(cut);
+    s.saveToFlash();
+    flash.failAfter(-1);
+    ApplicationSettings loaded;
+    loaded.init(flash, flash.getAddress());
+    CHECK_EQUAL(loaded.program_index, cut < 2 ? 3 : 4);
+    loaded.program_index = 5;
+    loaded.saveToFlash();
+    ApplicationSettings reloaded;
+    reloaded.init(flash, flash.getAddress());
+    CHECK_EQUAL(reloaded.program_index, 5);
+  }
+}
+
+static void testClear(){
+  SimulatedFlash flash(1, SETTINGS_SECTOR_SIZE);
+  ApplicationSettings s;
+  s.init(flash, flash.getAddress());
+  s.saveToFlash();
+  s.clearFlash();
+  CHECK(!s.settingsInFlash());
+}
+
+int main(){
+  testDefaults();
+  testSaveAndLoad();
+  testWearLevelling();
+  testInterruptedSave();
+  testClear();
+  return testResult("ApplicationSettingsTest");
+}
@@ -0,0 +1,114 @@
+#include <pthread.h>
+#include <sched.h>
+#include "Test.h"
+#include "AudioEventQueue.hpp"
+
+/*
+ * The event queue with producers on several threads, standing in for
+ * interrupts that preempt each other, and the audio task as the only
+ * consumer. Every event must either arrive intact, in the order its
+ * producer pushed it, or be counted as dropped.
+ */
+
+#define PRODUCERS 3
+#define EVENTS 1000000
+
+static AudioEventQueue* queue;
+static volatile uint32_t pushed[PRODUCERS];
+
+static void* produce(void* arg){
+  uint8_t id = (long)arg;
+  for(uint32_t i=0; i<EVENTS; ++i){
+    if(queue->push(AUDIO_EVENT_BUTTON, id, (int16_t)i, i))
+      pushed[id]++;
+    if(i % 32 == 0)
+      sched_yield(); // leave the consumer some time, on a single core too
+  }
+  return NULL;
+}
+
+static void testProducers(bool flushing){
+  queue = new AudioEventQueue();
+  pthread_t threads[PRODUCERS];
+  for(long i=0; i<PRODUCERS; ++i){
+    pushed[i] = 0;
+    pthread_create(&threads[i], NULL, produce, (void*)i);
+  }
+  uint32_t received[PRODUCERS] = {};
+  uint32_t last[PRODUCERS] = {};
+  int errors = 0;
+  int flushes = 0;
+  int popped = 0;
+  for(;;){
+    AudioEvent* event = queue->front();
+    if(event == NULL){
+      uint32_t done = 0;
+      for(int i=0; i<PRODUCERS; ++i)
+	done += pushed[i];
+      uint32_t total = 0;
+      for(int i=0; i<PRODUCERS; ++i)
+	total += received[i];
+      // with every event pushed, nothing may be left uncommitted
+      if(!flushing && total + queue->getDropped() == PRODUCERS*EVENTS)
+	break;
+      if(flushing && done + queue->getDropped() == PRODUCERS*EVENTS && queue->front() == NULL)
+	break;
+      sched_yield();
+      continue;
+    }
+    if(event->id >= PRODUCERS){
+      errors++;
+    }else{
+      uint8_t id = event->id;
+      if(event->type != AUDIO_EVENT_BUTTON || event->value != (int16_t)event->time)
+	errors++;
+      if(received[id] && event->time <= last[id])
+	errors++;
+      last[id] = event->time;
+      received[id]++;
+    }
+    queue->pop();
+    if(flushing && ++popped % 100 == 0){
+      queue->flush();
+      flushes++;
+    }
+  }
+  for(int i=0; i<PRODUCERS; ++i)
+    pthread_join(threads[i], NULL);
+  CHECK_EQUAL(errors, 0);
+  uint32_t total = 0;
+  for(int i=0; i<PRODUCERS; ++i){
+    if(!flushing)
+      CHECK_EQUAL(received[i], pushed[i]);
+    total += pushed[i];
+  }
+  CHECK_EQUAL(total + queue->getDropped(), PRODUCERS*EVENTS);
+  if(flushing)
+    CHECK(flushes > 0);
+  CHECK(queue->front() == NULL);
+  delete queue;
+}
+
+/* a full queue drops events and counts them, and takes new ones once read */
+static void testFull(){
+  AudioEventQueue queue;
+  for(int i=0; i<AUDIO_EVENT_QUEUE_SIZE; ++i)
+    CHECK(queue.push(AUDIO_EVENT_BUTTON, 1, i, i));
+  CHECK(!queue.push(AUDIO_EVENT_BUTTON, 1, 0, 0));
+  CHECK_EQUAL(queue.getDropped(), 1);
+  CHECK(queue.front() != NULL);
+  CHECK_EQUAL(queue.front()->value, 0);
+  queue.pop();
+  CHECK(queue.push(AUDIO_EVENT_BUTTON, 2, 100, 100));
+  queue.flush();
+  CHECK(queue.front() == NULL);
+  CHECK(queue.push(AUDIO_EVENT_BUTTON, 3, 200, 200));
+  CHECK(queue.front() != NULL && queue.front()->id == 3);
+}
+
+int main(){
+  testFull();
+  testProducers(false);
+  testProducers(true);
+  return testResult("AudioEventQueueTest");
+}
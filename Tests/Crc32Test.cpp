@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <string.h>
+#include "Test.h"
+#include "crc32.h"
+
+/*
+ * The word-at-a-time crc32 and crc32_copy against a plain byte-wise
+ * reference, for every start alignment and a range of lengths: the
+ * checksums of stored patches and firmware must not change.
+ */
+
+static uint32_t table[256];
+
+static void makeTable(){
+  for(uint32_t i=0; i<256; ++i){
+    uint32_t c = i;
+    for(int j=0; j<8; ++j)
+      c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+    table[i] = c;
+  }
+}
+
+static uint32_t reference(const uint8_t* p, size_t size, uint32_t crc){
+  crc = ~crc;
+  while(size--)
+    crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+#define BUFFER_SIZE (64*1024+16)
+
+static uint8_t data[BUFFER_SIZE];
+static uint8_t copy[BUFFER_SIZE];
+
+static void testCheckValue(){
+  const char* check = "123456789";
+  CHECK_EQUAL(crc32(check, 9, 0), 0xCBF43926);
+  CHECK_EQUAL(crc32_copy(copy, check, 9, 0), 0xCBF43926);
+  CHECK_EQUAL(crc32(check, 0, 0), 0);
+}
+
+/* one call at a time and copies, from every alignment */
+static void testAlignments(){
+  static const size_t large[] = { 255, 1024, 4093, 65536 };
+  int errors = 0;
+  for(size_t offset=0; offset<8; ++offset){
+    for(size_t size=0; size<=64+4; ++size){
+      size_t len = size <= 64 ? size : large[size-65];
+      uint32_t expected = reference(data+offset, len, 0);
+      if(crc32(data+offset, len, 0) != expected)
+	errors++;
+      // copy to a destination with a different alignment
+      size_t to = 7-offset;
+      memset(copy, 0xaa, BUFFER_SIZE);
+      if(crc32_copy(copy+to, data+offset, len, 0) != expected)
+	errors++;
+      if(memcmp(copy+to, data+offset, len) != 0)
+	errors++;
+      // nothing is written past the end
+      if(copy[to+len] != 0xaa || (to > 0 && copy[to-1] != 0xaa))
+	errors++;
+    }
+  }
+  CHECK_EQUAL(errors, 0);
+}
+
+/* a checksum computed in pieces, as the upload and flash code do */
+static void testChained(){
+  int errors = 0;
+  size_t size = 10000;
+  uint32_t expected = reference(data+3, size, 0);
+  for(int i=0; i<1000; ++i){
+    uint32_t crc = 0;
+    uint32_t copied = 0;
+    size_t pos = 0;
+    while(pos < size){
+      size_t len = rand() % 300;
+      if(len > size - pos)
+	len = size - pos;
+      crc = crc32(data+3+pos, len, crc);
+      copied = crc32_copy(copy+pos, data+3+pos, len, copied);
+      pos += len;
+    }
+    if(crc != expected || copied != expected || memcmp(copy, data+3, size) != 0)
+      errors++;
+  }
+  CHECK_EQUAL(errors, 0);
+}
+
+int main(){
+  makeTable();
+  srand(32);
+  for(int i=0; i<BUFFER_SIZE; ++i)
+    data[i] = rand();
+  testCheckValue();
+  testAlignments();
+  testChained();
+  return testResult("Crc32Test");
+}
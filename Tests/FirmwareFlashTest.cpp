@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <string.h>
+#include "Test.h"
+#include "device.h"
+#include "SimulatedEeprom.h"
+#include "flashupdate.h"
+
+/*
+ * Firmware updates on a simulated internal flash: sectors 2 to 6 are
+ * updated as flashFirmware does, and only sectors that differ from the
+ * new image, including erased flash past its end, are erased.
+ */
+
+static const uint32_t sectorAddresses[] = {
+  ADDR_FLASH_SECTOR_2, ADDR_FLASH_SECTOR_3, ADDR_FLASH_SECTOR_4,
+  ADDR_FLASH_SECTOR_5, ADDR_FLASH_SECTOR_6, ADDR_FLASH_SECTOR_7
+};
+
+static uint32_t image[MAX_SYSEX_FIRMWARE_SIZE/4];
+
+static int flashImage(uint32_t size){
+  int programmed = 0;
+  eeprom_unlock();
+  for(int i=0; i<5; ++i){
+    uint32_t address = sectorAddresses[i];
+    uint32_t length = sectorAddresses[i+1] - address;
+    uint32_t offset = address - ADDR_FLASH_SECTOR_2;
+    uint32_t count = 0;
+    if(offset < size)
+      count = size - offset < length ? size - offset : length;
+    int ret = flash_update_sector(SIMULATED_FLASH_SECTOR(i+2), address, length,
+				  (uint8_t*)image + offset, count);
+    CHECK(ret >= 0);
+    programmed += ret;
+  }
+  eeprom_lock();
+  return programmed;
+}
+
+/* the firmware sectors hold the image followed by erased flash */
+static bool hasImage(uint32_t size){
+  const uint8_t* flash = (const uint8_t*)(uintptr_t)ADDR_FLASH_SECTOR_2;
+  if(memcmp(flash, image, size) != 0)
+    return false;
+  for(uint32_t i=size; i<MAX_SYSEX_FIRMWARE_SIZE; ++i)
+    if(flash[i] != 0xff)
+      return false;
+  return true;
+}
+
+static void makeImage(uint32_t size, uint32_t seed){
+  srand(seed);
+  uint8_t* data = (uint8_t*)image;
+  for(uint32_t i=0; i<size; ++i)
+    data[i] = rand();
+  // stale data past the end of the image in the source buffer
+  memset(data+size, 0x5a, sizeof(image)-size);
+}
+
+int main(){
+  if(simulated_eeprom_init() != 0){
+    printf("FirmwareFlashTest: failed to map simulated flash\n");
+    return 1;
+  }
+  uint32_t size = 300*1024+2; // ends in sector 6, with a partial word
+  makeImage(size, 1);
+  CHECK_EQUAL(flashImage(size), 5);
+  CHECK(hasImage(size));
+  double full = simulated_eeprom_get_seconds();
+
+  // the same image again: nothing to do
+  simulated_eeprom_reset_counters();
+  CHECK_EQUAL(flashImage(size), 0);
+  CHECK_EQUAL(simulated_eeprom_get_erases(), 0);
+
+  // a change in sector 4 only
+  ((uint8_t*)image)[40*1024] ^= 1;
+  simulated_eeprom_reset_counters();
+  CHECK_EQUAL(flashImage(size), 1);
+  CHECK_EQUAL(simulated_eeprom_get_erases(), 1);
+  CHECK(hasImage(size));
+  double partial = simulated_eeprom_get_seconds();
+
+  // a shorter image, with the same start: the tail of the old one is erased
+  uint32_t shorter = 100*1024;
+  memset((uint8_t*)image+shorter, 0x5a, sizeof(image)-shorter);
+  simulated_eeprom_reset_counters();
+  CHECK_EQUAL(flashImage(shorter), 2); // sectors 5 and 6
+  CHECK(hasImage(shorter));
+
+  // an image that ends in erased words is stored in full
+  memset((uint8_t*)image+shorter-64, 0xff, 64);
+  simulated_eeprom_reset_counters();
+  CHECK_EQUAL(flashImage(shorter), 1);
+  CHECK(hasImage(shorter));
+
+  // a longer image again
+  makeImage(size, 2);
+  CHECK_EQUAL(flashImage(size), 5);
+  CHECK(hasImage(size));
+  CHECK_EQUAL(simulated_eeprom_get_errors(), 0);
+
+  // the size and checksum stored with an image are found in front of erased flash
+  uint32_t found = 0, crc = 0;
+  CHECK(flash_find_footer(ADDR_FLASH_SECTOR_2, MAX_SYSEX_FIRMWARE_SIZE, &found, &crc) != 0);
+  memset((uint8_t*)image+shorter-64, 0xff, 64); // ends in erased words
+  uint32_t stored = flash_append_footer((uint8_t*)image, shorter+1, 0x12345678);
+  CHECK_EQUAL(stored, shorter+4+12);
+  CHECK(flashImage(stored) > 0);
+  CHECK(hasImage(stored));
+  CHECK_EQUAL(flash_find_footer(ADDR_FLASH_SECTOR_2, MAX_SYSEX_FIRMWARE_SIZE, &found, &crc), 0);
+  CHECK_EQUAL(found, shorter+1);
+  CHECK_EQUAL(crc, 0x12345678);
+
+  printf("full update %.2f s, one sector changed %.2f s\n", full, partial);
+  return testResult("FirmwareFlashTest");
+}
@@ -0,0 +1,69 @@
+#include <stdlib.h>
+#include <string.h>
+#include "Test.h"
+#include "device.h"
+#include "sysex.h"
+#include "crc32.h"
+
+/*
+ * Decode and checksum a firmware image sent as sysex packages, the way
+ * FirmwareLoader does as each package arrives, and compare the longest
+ * time spent on one package with a crc32 over the whole image at the end.
+ */
+
+#define IMAGE_SIZE MAX_SYSEX_FIRMWARE_SIZE
+#define CHUNK (28*7) // data bytes per package, as sent by sendFlashTask
+#define REPEATS 20
+
+static uint8_t image[IMAGE_SIZE];
+static uint8_t encoded[IMAGE_SIZE/7*8+8];
+static uint8_t decoded[IMAGE_SIZE];
+
+int main(){
+  srand(1);
+  for(uint32_t i=0; i<IMAGE_SIZE; ++i)
+    image[i] = rand();
+  uint32_t expected = crc32(image, IMAGE_SIZE, 0);
+  // encode package by package
+  uint32_t offsets[IMAGE_SIZE/CHUNK+2];
+  uint32_t packages = 0;
+  uint32_t length = 0;
+  for(uint32_t i=0; i<IMAGE_SIZE; i+=CHUNK){
+    offsets[packages++] = length;
+    uint32_t len = IMAGE_SIZE-i < CHUNK ? IMAGE_SIZE-i : CHUNK;
+    length += data_to_sysex(image+i, encoded+length, len);
+  }
+  offsets[packages] = length;
+
+  double total = 0;
+  double worst = 0;
+  for(int r=0; r<REPEATS; ++r){
+    memset(decoded, 0, sizeof(decoded));
+    uint32_t crc = 0;
+    uint32_t index = 0;
+    for(uint32_t p=0; p<packages; ++p){
+      double start = getSeconds();
+      uint32_t len = sysex_to_data(encoded+offsets[p], decoded+index, offsets[p+1]-offsets[p]);
+      crc = crc32(decoded+index, len, crc);
+      double t = getSeconds() - start;
+      index += len;
+      total += t;
+      if(t > worst)
+	worst = t;
+    }
+    CHECK_EQUAL(index, IMAGE_SIZE);
+    CHECK_EQUAL(crc, expected);
+  }
+  CHECK(memcmp(image, decoded, IMAGE_SIZE) == 0);
+
+  double start = getSeconds();
+  for(int r=0; r<REPEATS; ++r)
+    CHECK_EQUAL(crc32(decoded, IMAGE_SIZE, 0), expected);
+  double whole = (getSeconds() - start)/REPEATS;
+
+  printf("decode+crc: %.1f MB/s, %u packages, %.2f us per package, longest %.2f us\n",
+	 IMAGE_SIZE*REPEATS/total/1e6, packages, total/packages/REPEATS*1e6, worst*1e6);
+  printf("crc32 of the whole image when the last package arrives: %.2f us\n",
+	 whole*1e6);
+  return testResult("FirmwareUploadBenchmark");
+}
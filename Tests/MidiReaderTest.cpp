@@ -0,0 +1,210 @@
+#include <stdlib.h>
+#include <string.h>
+#include "Test.h"
+#include "MidiReader.hpp"
+
+/*
+ * Fuzz test and benchmark of the packet decoder MidiReader::readPackets,
+ * against the byte at a time decoding it replaced: random USB transfers of
+ * channel messages and sysex must give the same handler calls both ways.
+ */
+
+#define MAX_SYSEX 256
+#define LOG_SIZE (64*1024)
+#define TRANSFER_SIZE 64
+
+/* records every handler call, so that two readers can be compared */
+class LoggingReader : public MidiReader {
+private:
+  uint8_t buffer[MAX_SYSEX];
+  void log(uint8_t type, uint8_t a, uint8_t b, uint8_t c){
+    if(length+4 <= LOG_SIZE){
+      calls[length++] = type;
+      calls[length++] = a;
+      calls[length++] = b;
+      calls[length++] = c;
+    }
+  }
+public:
+  uint8_t calls[LOG_SIZE];
+  uint32_t length;
+  uint32_t sysex;
+  LoggingReader() : MidiReader(buffer, sizeof(buffer)), length(0), sysex(0) {}
+  void handleSystemCommon(uint8_t cmd){ log(1, cmd, 0, 0); }
+  void handleProgramChange(uint8_t status, uint8_t pc){ log(2, status, pc, 0); }
+  void handleChannelPressure(uint8_t status, uint8_t value){ log(3, status, value, 0); }
+  void handleControlChange(uint8_t status, uint8_t cc, uint8_t value){ log(4, status, cc, value); }
+  void handleNoteOff(uint8_t status, uint8_t note, uint8_t velocity){ log(5, status, note, velocity); }
+  void handleNoteOn(uint8_t status, uint8_t note, uint8_t velocity){ log(6, status, note, velocity); }
+  void handlePitchBend(uint8_t status, uint16_t value){ log(7, status, value >> 8, value); }
+  void handlePolyKeyPressure(uint8_t status, uint8_t note, uint8_t value){ log(8, status, note, value); }
+  void handleSysEx(uint8_t* data, uint16_t size){
+    log(9, size >> 8, size, 0);
+    for(uint16_t i=0; i<size; ++i)
+      log(10, data[i], 0, 0);
+    sysex++;
+  }
+  void reset(){
+    length = 0;
+    sysex = 0;
+    clear();
+  }
+};
+
+/* the byte-wise decoding of a USB transfer that readPackets replaced */
+static void readBytes(MidiReader& reader, const uint8_t* buffer, uint16_t length){
+  for(int i=1; i<length; ++i){
+    // skip every 4th byte
+    if(i & 0x3){
+      if(reader.read(buffer[i]) == ERROR_STATUS){
+	reader.clear();
+	return; // discard the rest of the message
+      }
+    }
+  }
+}
+
+static uint8_t* addPacket(uint8_t* p, uint8_t cin, uint8_t b1, uint8_t b2, uint8_t b3){
+  p[0] = cin;
+  p[1] = b1;
+  p[2] = b2;
+  p[3] = b3;
+  return p+4;
+}
+
+/* a sysex message of len data bytes, split into USB-MIDI packets */
+static uint8_t* addSysEx(uint8_t* p, int len){
+  uint8_t msg[MAX_SYSEX];
+  msg[0] = SYSEX;
+  for(int i=0; i<len; ++i)
+    msg[1+i] = rand() & 0x7f;
+  msg[len+1] = SYSEX_EOX;
+  int total = len+2;
+  for(int i=0; i<total; i+=3){
+    int left = total-i;
+    if(left > 3)
+      p = addPacket(p, USB_COMMAND_SYSEX, msg[i], msg[i+1], msg[i+2]);
+    else if(left == 3)
+      p = addPacket(p, USB_COMMAND_SYSEX_EOX3, msg[i], msg[i+1], msg[i+2]);
+    else if(left == 2)
+      p = addPacket(p, USB_COMMAND_SYSEX_EOX2, msg[i], msg[i+1], 0);
+    else
+      p = addPacket(p, USB_COMMAND_SYSEX_EOX1, msg[i], 0, 0);
+  }
+  return p;
+}
+
+static uint8_t* addChannelMessage(uint8_t* p){
+  static const uint8_t types[] = {
+    CONTROL_CHANGE, CONTROL_CHANGE, NOTE_ON, NOTE_OFF,
+    PITCH_BEND_CHANGE, POLY_KEY_PRESSURE
+  };
+  uint8_t status = types[rand() % sizeof(types)] | (rand() & MIDI_CHANNEL_MASK);
+  uint8_t value = rand() % 4 == 0 ? 0 : rand() & 0x7f; // note on with velocity 0
+  return addPacket(p, status >> 4, status, rand() & 0x7f, value);
+}
+
+static uint32_t makeStream(uint8_t* stream, uint32_t size){
+  uint8_t* p = stream;
+  uint8_t* end = stream + size - (MAX_SYSEX/3+2)*4;
+  while(p < end){
+    if(rand() % 8 == 0)
+      p = addSysEx(p, rand() % (MAX_SYSEX-2));
+    else
+      p = addChannelMessage(p);
+  }
+  return p - stream;
+}
+
+static LoggingReader packets;
+static LoggingReader bytes;
+
+static void testSameCalls(){
+  static uint8_t stream[16*1024];
+  srand(38);
+  for(int i=0; i<200; ++i){
+    uint32_t len = makeStream(stream, sizeof(stream));
+    packets.reset();
+    bytes.reset();
+    for(uint32_t j=0; j<len; j+=TRANSFER_SIZE){
+      uint16_t n = len-j < TRANSFER_SIZE ? len-j : TRANSFER_SIZE;
+      packets.readPackets(stream+j, n);
+      readBytes(bytes, stream+j, n);
+    }
+    CHECK(packets.length > 0);
+    CHECK(packets.sysex > 0);
+    CHECK_EQUAL(packets.length, bytes.length);
+    CHECK(memcmp(packets.calls, bytes.calls, packets.length) == 0);
+  }
+}
+
+/* cases where the packet decoder deliberately differs from the byte-wise one */
+static void testPackets(){
+  uint8_t stream[64];
+  uint8_t* p = stream;
+  // a real-time message in the middle of a sysex does not cut it short
+  p = addPacket(p, USB_COMMAND_SYSEX, SYSEX, 1, 2);
+  p = addPacket(p, USB_COMMAND_SINGLE_BYTE, TIMING_CLOCK, 0, 0);
+  p = addPacket(p, USB_COMMAND_SYSEX_EOX2, 3, SYSEX_EOX, 0);
+  packets.reset();
+  packets.readPackets(stream, p-stream);
+  CHECK_EQUAL(packets.sysex, 1);
+  CHECK_EQUAL(packets.length, 4+4+3*4);
+  CHECK_EQUAL(packets.calls[0], 1);
+  CHECK_EQUAL(packets.calls[1], TIMING_CLOCK);
+  CHECK_EQUAL(packets.calls[6], 3); // sysex size
+  // a continuation without a start drops only that message
+  p = stream;
+  p = addPacket(p, USB_COMMAND_SYSEX, 4, 5, 6);
+  p = addPacket(p, USB_COMMAND_CONTROL_CHANGE, CONTROL_CHANGE, 7, 8);
+  p = addPacket(p, USB_COMMAND_SYSEX_EOX1, SYSEX_EOX, 0, 0);
+  p = addPacket(p, USB_COMMAND_PROGRAM_CHANGE, PROGRAM_CHANGE|1, 9, 0);
+  packets.reset();
+  packets.readPackets(stream, p-stream);
+  CHECK_EQUAL(packets.sysex, 0);
+  CHECK_EQUAL(packets.length, 8);
+  CHECK_EQUAL(packets.calls[0], 4);
+  CHECK_EQUAL(packets.calls[4], 2);
+  // a sysex longer than the buffer is dropped, and the next one is read
+  p = stream;
+  packets.reset();
+  p = addPacket(p, USB_COMMAND_SYSEX, SYSEX, 0, 0);
+  packets.readPackets(stream, p-stream);
+  for(int i=0; i<MAX_SYSEX/3; ++i){
+    addPacket(stream, USB_COMMAND_SYSEX, 1, 2, 3);
+    packets.readPackets(stream, 4);
+  }
+  p = addSysEx(stream, 5);
+  packets.readPackets(stream, p-stream);
+  CHECK_EQUAL(packets.sysex, 1);
+  CHECK_EQUAL(packets.calls[2], 5);
+}
+
+static void benchmark(){
+  static uint8_t stream[256*1024];
+  srand(39);
+  uint32_t len = makeStream(stream, sizeof(stream));
+  const int repeats = 20;
+  double t0 = getSeconds();
+  for(int r=0; r<repeats; ++r){
+    packets.reset();
+    for(uint32_t j=0; j<len; j+=TRANSFER_SIZE)
+      packets.readPackets(stream+j, len-j < TRANSFER_SIZE ? len-j : TRANSFER_SIZE);
+  }
+  double t1 = getSeconds();
+  for(int r=0; r<repeats; ++r){
+    bytes.reset();
+    for(uint32_t j=0; j<len; j+=TRANSFER_SIZE)
+      readBytes(bytes, stream+j, len-j < TRANSFER_SIZE ? len-j : TRANSFER_SIZE);
+  }
+  double t2 = getSeconds();
+  double mb = len*(double)repeats/1e6;
+  printf("decode: %.1f MB/s, byte-wise %.1f MB/s\n", mb/(t1-t0), mb/(t2-t1));
+}
+
+int main(){
+  testSameCalls();
+  testPackets();
+  benchmark();
+  return testResult("MidiReaderTest");
+}
@@ -0,0 +1,133 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "Test.h"
+#include "ParameterAutomation.h"
+
+/*
+ * Parameter automation against a simulated audio clock: points sent on
+ * the host's sample clock arrive with random delays, and the values the
+ * audio task sees for every sample must follow the curve through the
+ * points, whatever the delays.
+ */
+
+#define BLOCKSIZE 64
+#define INTERVAL 48    /* samples between points */
+#define DELAY 1000     /* samples from sending to arrival */
+#define JITTER 300     /* added to the delay, less than the latency */
+#define POINTS 2000
+#define PID 3
+
+struct SentPoint {
+  uint32_t time;    // host clock
+  uint32_t arrival; // audio clock
+  uint16_t value;
+};
+
+static SentPoint sent[POINTS];
+static int16_t parameters[NOF_PARAMETERS];
+static float samples[BLOCKSIZE];
+
+static void makePoints(uint32_t seed, int jitter){
+  srand(seed);
+  uint32_t host = 0x0ffff000; // wraps the 28-bit host time
+  uint16_t value = 8192;
+  for(int i=0; i<POINTS; ++i){
+    sent[i].time = (host + i*INTERVAL) & PARAMETER_AUTOMATION_TIME_MASK;
+    sent[i].arrival = 5000 + i*INTERVAL + DELAY + (i == 0 ? 0 : rand() % (jitter+1));
+    value = (value + rand() % 2001 - 1000) & 0x3fff;
+    sent[i].value = i == POINTS-1 ? 16383 : value;
+  }
+}
+
+/* the curve through the points, as placed on the audio clock by the first one */
+static double idealValue(uint32_t t){
+  uint32_t offset = sent[0].arrival + PARAMETER_AUTOMATION_LATENCY;
+  int i = 0;
+  while(i < POINTS-1 && offset + (i+1)*INTERVAL <= t)
+    i++;
+  if(i == POINTS-1)
+    return sent[i].value;
+  double pos = (double)(t - (offset + i*INTERVAL))/INTERVAL;
+  return sent[i].value + (sent[i+1].value - sent[i].value)*pos;
+}
+
+/* run the audio clock, delivering each point when it arrives */
+static void testJitter(uint32_t seed, int jitter){
+  ParameterAutomation* automation = new ParameterAutomation();
+  makePoints(seed, jitter);
+  memset(parameters, 0, sizeof(parameters));
+  // the curve starts at the first point, from wherever the parameter was
+  uint32_t first = sent[0].arrival + PARAMETER_AUTOMATION_LATENCY;
+  uint32_t end = sent[POINTS-1].arrival + PARAMETER_AUTOMATION_LATENCY + 4*BLOCKSIZE;
+  int next = 0;
+  double error = 0;
+  int checked = 0;
+  for(uint32_t start=0; start<end; start+=BLOCKSIZE){
+    // the block that starts at start is processed once it has been received
+    uint32_t now = start+BLOCKSIZE;
+    while(next < POINTS && sent[next].arrival <= now){
+      CHECK(automation->add(PID, sent[next].value, sent[next].time, sent[next].arrival));
+      next++;
+    }
+    automation->process(parameters, NOF_PARAMETERS, BLOCKSIZE, start);
+    automation->getSamples(PID, samples, BLOCKSIZE, parameters[PID]);
+    if(start >= first){
+      for(int i=0; i<BLOCKSIZE; ++i){
+	double e = fabs(samples[i]*16384 - idealValue(start+i));
+	error = e > error ? e : error;
+      }
+      int16_t last = (int16_t)idealValue(start+BLOCKSIZE-1)>>2;
+      CHECK(abs(parameters[PID] - last) <= 1);
+      checked++;
+    }
+  }
+  CHECK(checked > POINTS*INTERVAL/BLOCKSIZE/2);
+  CHECK(error < 0.01);
+  CHECK_EQUAL(automation->getResyncs(), 0);
+  CHECK_EQUAL(automation->getDropped(), 0);
+  // the curve ends on the full scale value of the last point
+  CHECK_EQUAL(parameters[PID], 4095);
+  CHECK(samples[BLOCKSIZE-1] == 16383.0f/16384);
+  delete automation;
+}
+
+/* a point that arrives after its time moves the mapping, and the curve carries on */
+static void testLatePoint(){
+  ParameterAutomation* automation = new ParameterAutomation();
+  memset(parameters, 0, sizeof(parameters));
+  CHECK(automation->add(PID, 1000, 0, 0));
+  CHECK(automation->add(PID, 2000, 100, 2*PARAMETER_AUTOMATION_LATENCY));
+  CHECK_EQUAL(automation->getResyncs(), 1);
+  for(uint32_t start=0; start<4*PARAMETER_AUTOMATION_LATENCY; start+=BLOCKSIZE)
+    automation->process(parameters, NOF_PARAMETERS, BLOCKSIZE, start);
+  CHECK_EQUAL(parameters[PID], 2000>>2);
+  delete automation;
+}
+
+/* points for parameters the program does not have are discarded */
+static void testFewerParameters(){
+  ParameterAutomation* automation = new ParameterAutomation();
+  memset(parameters, 0, sizeof(parameters));
+  for(int i=0; i<PARAMETER_AUTOMATION_POINTS; ++i)
+    CHECK(automation->add(30, 4000, i*INTERVAL, 0));
+  CHECK(!automation->add(30, 4000, 0, 0));
+  automation->process(parameters, 24, BLOCKSIZE, 0);
+  CHECK_EQUAL(parameters[30], 0);
+  // the queue is empty again, and nothing is left running
+  CHECK(automation->add(30, 8000, 2000, 0));
+  automation->getSamples(30, samples, BLOCKSIZE, 100);
+  CHECK(samples[0] == 400.0f/16384);
+  automation->process(parameters, NOF_PARAMETERS, BLOCKSIZE, 4*PARAMETER_AUTOMATION_LATENCY);
+  CHECK_EQUAL(parameters[30], 2000);
+  delete automation;
+}
+
+int main(){
+  testJitter(41, 0);
+  testJitter(42, JITTER);
+  testJitter(43, JITTER);
+  testLatePoint();
+  testFewerParameters();
+  return testResult("ParameterAutomationTest");
+}
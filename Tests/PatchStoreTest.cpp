@@ -0,0 +1,162 @@
+#include <stdlib.h>
+#include <string.h>
+#include "Test.h"
+#include "SimulatedFlash.h"
+#include "ProgramVector.h"
+#include "ProgramHeader.h"
+#include "PatchStore.h"
+
+static uint8_t patches[MAX_USER_PATCHES][MAX_SYSEX_PROGRAM_SIZE];
+static uint32_t sizes[MAX_USER_PATCHES];
+
+static void makePatch(uint8_t slot, uint32_t size, uint32_t seed){
+  srand(seed);
+  for(uint32_t i=0; i<size; ++i)
+    patches[slot][i] = rand();
+  sizes[slot] = size;
+}
+
+static bool hasPatch(PatchStore& store, uint8_t slot){
+  return store.getPatchSize(slot) == sizes[slot] &&
+    store.getPatchAddress(slot) != NULL &&
+    memcmp(store.getPatchAddress(slot), patches[slot], sizes[slot]) == 0;
+}
+
+static void checkPatches(PatchStore& store){
+  for(int i=0; i<MAX_USER_PATCHES; ++i){
+    if(sizes[i])
+      CHECK(hasPatch(store, i));
+    else
+      CHECK(store.getPatchAddress(i) == NULL);
+  }
+}
+
+static int writePatch(PatchStore& store, uint8_t slot, uint32_t size, uint32_t seed){
+  makePatch(slot, size, seed);
+  return store.write(slot, patches[slot], size);
+}
+
+/* write a patch in the one-patch-per-sector layout: sector 3 holds slot 0 */
+static void writeLegacyPatch(SimulatedFlash& flash, uint8_t slot, uint32_t size){
+  makePatch(slot, size, slot+100);
+  ProgramHeader* header = (ProgramHeader*)patches[slot];
+  memset(header, 0, sizeof(ProgramHeader));
+  header->magic = PROGRAM_HEADER_MAGIC_V1;
+  header->linkAddress = (uint32_t*)(uintptr_t)PATCHRAM;
+  header->endAddress = (uint32_t*)(uintptr_t)(PATCHRAM+size);
+  uint32_t address = flash.getAddress()+(PATCH_STORE_SECTORS-1-slot)*PATCH_STORE_SECTOR_SIZE;
+  flash.unlock();
+  flash.write(address, patches[slot], size);
+  flash.lock();
+}
+
+static void testWriteAndErase(){
+  SimulatedFlash flash(PATCH_STORE_SECTORS, PATCH_STORE_SECTOR_SIZE);
+  PatchStore store(flash, flash.getAddress());
+  memset(sizes, 0, sizeof(sizes));
+  store.init();
+  checkPatches(store);
+  CHECK_EQUAL(writePatch(store, 0, 1000, 1), 0);
+  CHECK_EQUAL(writePatch(store, 5, 4321, 2), 0);
+  CHECK_EQUAL(writePatch(store, 0, 2001, 3), 0);
+  checkPatches(store);
+  CHECK(store.hasPatchChecksum(5));
+  CHECK_EQUAL(store.erase(5), 0);
+  sizes[5] = 0;
+  checkPatches(store);
+  // several small patches share one sector
+  CHECK_EQUAL(flash.erases, 0);
+  PatchStore reloaded(flash, flash.getAddress());
+  reloaded.init();
+  checkPatches(reloaded);
+  CHECK_EQUAL(flash.errors, 0);
+  CHECK(flash.isLocked());
+}
+
+static void testGarbageCollection(){
+  SimulatedFlash flash(PATCH_STORE_SECTORS, PATCH_STORE_SECTOR_SIZE);
+  PatchStore store(flash, flash.getAddress());
+  memset(sizes, 0, sizeof(sizes));
+  store.format();
+  flash.erases = 0;
+  for(int i=0; i<500; ++i){
+    uint8_t slot = i % MAX_USER_PATCHES;
+    uint32_t size = 1000 + (i*7919) % (16*1024);
+    CHECK_EQUAL(writePatch(store, slot, size, i), 0);
+  }
+  checkPatches(store);
+  CHECK(flash.erases > 0);
+  PatchStore reloaded(flash, flash.getAddress());
+  reloaded.init();
+  checkPatches(reloaded);
+  // a full sector's worth of free space is always held back as the spare
+  CHECK(reloaded.getFreeSpace() < (PATCH_STORE_SECTORS-1)*PATCH_STORE_SECTOR_SIZE);
+  CHECK_EQUAL(flash.errors, 0);
+}
+
+static void testLegacyMigration(){
+  SimulatedFlash flash(PATCH_STORE_SECTORS, PATCH_STORE_SECTOR_SIZE);
+  memset(sizes, 0, sizeof(sizes));
+  for(int slot=0; slot<PATCH_STORE_SECTORS; ++slot)
+    writeLegacyPatch(flash, slot, 20*1024+slot*1000);
+  PatchStore store(flash, flash.getAddress());
+  store.init();
+  checkPatches(store);
+  CHECK(!store.hasPatchChecksum(1));
+  // every sector holds an old layout patch: there is no spare to start with,
+  // so a new slot can not be stored until one of the old patches is replaced
+  CHECK_EQUAL(store.write(9, patches[0], 1000), -1);
+  checkPatches(store);
+  CHECK_EQUAL(writePatch(store, 1, 30*1024, 7), 0);
+  checkPatches(store);
+  CHECK_EQUAL(writePatch(store, 9, 50*1024, 8), 0);
+  CHECK_EQUAL(writePatch(store, 2, 70*1024, 9), 0);
+  CHECK_EQUAL(writePatch(store, 3, 80*1024, 10), 0);
+  checkPatches(store);
+  PatchStore reloaded(flash, flash.getAddress());
+  reloaded.init();
+  checkPatches(reloaded);
+  CHECK(reloaded.hasPatchChecksum(0));
+  CHECK_EQUAL(flash.errors, 0);
+}
+
+/* cut the power at every flash operation of a write, and check that the old or the new patch survives */
+static void testInterruptedWrites(){
+  static uint8_t before[MAX_USER_PATCHES][MAX_SYSEX_PROGRAM_SIZE];
+  static uint32_t beforeSizes[MAX_USER_PATCHES];
+  for(int cut=0; cut<64; ++cut){
+    SimulatedFlash flash(PATCH_STORE_SECTORS, PATCH_STORE_SECTOR_SIZE);
+    memset(sizes, 0, sizeof(sizes));
+    for(int slot=0; slot<PATCH_STORE_SECTORS-1; ++slot)
+      writeLegacyPatch(flash, slot, 40*1024);
+    PatchStore store(flash, flash.getAddress());
+    store.init();
+    for(int i=0; i<12; ++i)
+      CHECK_EQUAL(writePatch(store, 4+i, 10*1024, i), 0);
+    memcpy(before, patches, sizeof(patches));
+    memcpy(beforeSizes, sizes, sizeof(sizes));
+    flash.failAfter(cut);
+    int ret = writePatch(store, 2, 60*1024, cut);
+    flash.failAfter(-1);
+    PatchStore reloaded(flash, flash.getAddress());
+    reloaded.init();
+    if(ret != 0){
+      // the slot being written holds either patch, all others are intact
+      if(!hasPatch(reloaded, 2)){
+	memcpy(patches, before, sizeof(patches));
+	memcpy(sizes, beforeSizes, sizeof(sizes));
+      }
+    }
+    checkPatches(reloaded);
+    CHECK_EQUAL(writePatch(reloaded, 2, 10*1024, 1000+cut), 0);
+    checkPatches(reloaded);
+  }
+}
+
+int main(){
+  testWriteAndErase();
+  testGarbageCollection();
+  testLegacyMigration();
+  testInterruptedWrites();
+  return testResult("PatchStoreTest");
+}
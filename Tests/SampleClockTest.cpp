@@ -0,0 +1,47 @@
+#include <stdlib.h>
+#include "Test.h"
+#include "i2s.h"
+
+/*
+ * The sample clock derived from the audio DMA, against a simulated ring
+ * of two blocks of stereo 24-bit samples: the DMA moves one half word at
+ * a time, and the block interrupt is handled with a random latency of up
+ * to 3/4 of a block. The clock must always equal the number of frames
+ * received, and never go back.
+ */
+
+#define HALFWORDS_PER_FRAME 4 /* two channels of two half words */
+
+static void testBlocksize(uint16_t blocksz){
+  uint16_t szbuf = blocksz*HALFWORDS_PER_FRAME;
+  uint32_t remaining = szbuf*2;
+  uint32_t blocks = 0;
+  uint32_t received = 0;
+  uint32_t last = 0;
+  int pending = 0;
+  int errors = 0;
+  srand(blocksz);
+  for(long step=0; step<1000000; ++step){
+    remaining--;
+    received++;
+    if(remaining == szbuf || remaining == 0)
+      pending++;
+    if(remaining == 0)
+      remaining = szbuf*2; // circular mode reloads the counter
+    if(pending && (rand() % (blocksz*3) == 0 || received % szbuf > szbuf*3/4)){
+      blocks++;
+      pending--;
+    }
+    uint32_t clock = sampleClockFromDma(blocks, remaining, szbuf, blocksz);
+    if(clock != received/HALFWORDS_PER_FRAME || clock < last)
+      errors++;
+    last = clock;
+  }
+  CHECK_EQUAL(errors, 0);
+}
+
+int main(){
+  for(uint16_t blocksz=16; blocksz<=1024; blocksz*=2)
+    testBlocksize(blocksz);
+  return testResult("SampleClockTest");
+}
@@ -0,0 +1,113 @@
+#include <string.h>
+#include <sys/mman.h>
+#include "SimulatedEeprom.h"
+
+#define FLASH_BASE_ADDRESS ADDR_FLASH_SECTOR_0
+#define FLASH_SIZE (1024*1024)
+#define WORD_PROGRAM_SECONDS 16e-6
+
+static const uint32_t sectorSizes[] = {
+  16*1024, 16*1024, 16*1024, 16*1024, 64*1024,
+  128*1024, 128*1024, 128*1024, 128*1024, 128*1024, 128*1024, 128*1024
+};
+
+static const double sectorEraseSeconds[] = {
+  0.25, 0.25, 0.25, 0.25, 0.55, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0
+};
+
+static int unlocked;
+static int erases;
+static int words;
+static int errors;
+static double seconds;
+
+int simulated_eeprom_init(){
+  void* memory = mmap((void*)FLASH_BASE_ADDRESS, FLASH_SIZE, PROT_READ|PROT_WRITE,
+		      MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED_NOREPLACE, -1, 0);
+  if(memory != (void*)FLASH_BASE_ADDRESS)
+    return -1;
+  memset(memory, 0xff, FLASH_SIZE);
+  simulated_eeprom_reset_counters();
+  return 0;
+}
+
+void simulated_eeprom_reset_counters(){
+  erases = 0;
+  words = 0;
+  errors = 0;
+  seconds = 0;
+}
+
+int simulated_eeprom_get_erases(){
+  return erases;
+}
+
+int simulated_eeprom_get_words(){
+  return words;
+}
+
+int simulated_eeprom_get_errors(){
+  return errors;
+}
+
+double simulated_eeprom_get_seconds(){
+  return seconds;
+}
+
+void eeprom_lock(){
+  unlocked = 0;
+}
+
+void eeprom_unlock(){
+  unlocked = 1;
+}
+
+int eeprom_wait(){
+  return 0;
+}
+
+int eeprom_erase_sector(uint32_t sector){
+  uint32_t index = sector >> 3;
+  if(!unlocked || (sector & 7) || index >= sizeof(sectorSizes)/sizeof(sectorSizes[0])){
+    errors++;
+    return -1;
+  }
+  uint32_t address = FLASH_BASE_ADDRESS;
+  for(uint32_t i=0; i<index; ++i)
+    address += sectorSizes[i];
+  memset((void*)(uintptr_t)address, 0xff, sectorSizes[index]);
+  erases++;
+  seconds += sectorEraseSeconds[index];
+  return 0;
+}
+
+int eeprom_erase(uint32_t address){
+  uint32_t start = FLASH_BASE_ADDRESS;
+  for(uint32_t i=0; i<sizeof(sectorSizes)/sizeof(sectorSizes[0]); ++i){
+    if(address >= start && address < start+sectorSizes[i])
+      return eeprom_erase_sector(SIMULATED_FLASH_SECTOR(i));
+    start += sectorSizes[i];
+  }
+  errors++;
+  return -1;
+}
+
+int eeprom_write_block(uint32_t address, void* data, uint32_t size){
+  if(!unlocked || (address & 3) || address < FLASH_BASE_ADDRESS ||
+     address+size > FLASH_BASE_ADDRESS+FLASH_SIZE){
+    errors++;
+    return -1;
+  }
+  uint32_t* dest = (uint32_t*)(uintptr_t)address;
+  uint8_t* src = (uint8_t*)data;
+  for(uint32_t i=0; i<size; i+=4){
+    uint32_t word;
+    memcpy(&word, src+i, 4); /* whole words, like the target */
+    if(word & ~*dest)
+      errors++; /* programming can only clear bits */
+    *dest++ &= word;
+    words++;
+    seconds += WORD_PROGRAM_SECONDS;
+  }
+  return 0;
+}
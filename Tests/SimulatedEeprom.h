@@ -0,0 +1,32 @@
+#ifndef __SIMULATED_EEPROM_H
+#define __SIMULATED_EEPROM_H
+
+#include <stdint.h>
+#include "eepromcontrol.h"
+
+/*
+ * The eepromcontrol functions, on a copy of the internal flash that is
+ * mapped at its address on the target. Sector numbers are given in the
+ * FLASH_Sector_n format of the peripheral library. Erases and programmed
+ * words are counted, and timed with the typical figures of the STM32F407
+ * datasheet for x32 parallelism.
+ */
+
+#define SIMULATED_FLASH_SECTOR(n) ((n) << 3)
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+   int simulated_eeprom_init();
+   void simulated_eeprom_reset_counters();
+   int simulated_eeprom_get_erases();
+   int simulated_eeprom_get_words();
+   int simulated_eeprom_get_errors();
+   double simulated_eeprom_get_seconds();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SIMULATED_EEPROM_H */
@@ -0,0 +1,114 @@
+#ifndef __SimulatedFlash_h__
+#define __SimulatedFlash_h__
+
+#include <string.h>
+#include <sys/mman.h>
+#include "FlashBackend.h"
+
+/*
+ * Flash memory simulated in RAM, for testing code that stores data in
+ * flash on the host. The memory is mapped below 4G so that it can be
+ * addressed with 32-bit addresses, as on the target.
+ * Programming ANDs the new data into the old, like NOR flash does, and
+ * counts an error when a bit would have to go from 0 to 1.
+ * failAfter(n) simulates a power loss during the n+1th operation from then
+ * on: that write programs half its words, and all later operations fail
+ * without changing the memory.
+ */
+class SimulatedFlash : public FlashBackend {
+private:
+  uint8_t* memory;
+  uint32_t sectorSize;
+  uint32_t sectors;
+  bool unlocked;
+  int operationsLeft;
+  bool powerLost;
+  bool fail(){
+    if(operationsLeft < 0)
+      return false;
+    if(operationsLeft == 0)
+      return true;
+    operationsLeft--;
+    return false;
+  }
+public:
+  int erases;
+  int words;
+  int errors;
+  SimulatedFlash(uint32_t count, uint32_t size)
+    : sectorSize(size), sectors(count), unlocked(false), operationsLeft(-1),
+      powerLost(false), erases(0), words(0), errors(0) {
+    memory = (uint8_t*)mmap(NULL, count*size, PROT_READ|PROT_WRITE,
+			    MAP_PRIVATE|MAP_ANONYMOUS|MAP_32BIT, -1, 0);
+    if(memory == MAP_FAILED)
+      memory = NULL;
+    else
+      memset(memory, 0xff, count*size);
+  }
+  ~SimulatedFlash(){
+    if(memory != NULL)
+      munmap(memory, sectors*sectorSize);
+  }
+  uint32_t getAddress(){
+    return (uint32_t)(uintptr_t)memory;
+  }
+  uint32_t getSize(){
+    return sectors*sectorSize;
+  }
+  bool isLocked(){
+    return !unlocked;
+  }
+  void failAfter(int operations){
+    operationsLeft = operations;
+    powerLost = false;
+  }
+  void unlock(){
+    unlocked = true;
+  }
+  void lock(){
+    unlocked = false;
+  }
+  int erase(uint32_t address){
+    if(!unlocked || address < getAddress() || address >= getAddress()+getSize()){
+      errors++;
+      return -1;
+    }
+    if(powerLost)
+      return -1;
+    if(fail()){
+      powerLost = true;
+      return -1;
+    }
+    uint32_t offset = (address - getAddress()) / sectorSize * sectorSize;
+    memset(memory+offset, 0xff, sectorSize);
+    erases++;
+    return 0;
+  }
+  int write(uint32_t address, void* data, uint32_t size){
+    if(!unlocked || (address & 3) || address < getAddress() ||
+       address+size > getAddress()+getSize()){
+      errors++;
+      return -1;
+    }
+    if(powerLost)
+      return -1;
+    bool failed = fail();
+    if(failed){
+      powerLost = true;
+      size = (size+3)/8*4;
+    }
+    uint32_t* dest = (uint32_t*)(uintptr_t)address;
+    uint8_t* src = (uint8_t*)data;
+    for(uint32_t i=0; i<size; i+=4){
+      uint32_t word = 0xffffffff;
+      memcpy(&word, src+i, size-i < 4 ? size-i : 4);
+      if(word & ~*dest)
+	errors++;
+      *dest++ &= word;
+      words++;
+    }
+    return failed ? -1 : 0;
+  }
+};
+
+#endif // __SimulatedFlash_h__
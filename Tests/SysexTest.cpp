@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include <string.h>
+#include "Test.h"
+#include "sysex.h"
+
+/*
+ * Round trip fuzz test and benchmark of the 7-bit sysex codec, against
+ * the byte at a time implementation it replaced (with size_t lengths).
+ */
+
+static size_t reference_data_to_sysex(const uint8_t *data, uint8_t *sysex, size_t len){
+  size_t retlen = 0;
+  size_t cnt7 = 0;
+  sysex[0] = 0;
+  for(size_t cnt = 0; cnt < len; cnt++) {
+    sysex[0] |= (data[cnt] >> 7) << cnt7;
+    sysex[1 + cnt7] = data[cnt] & 0x7F;
+    if(cnt7++ == 6) {
+      sysex += 8;
+      retlen += 8;
+      sysex[0] = 0;
+      cnt7 = 0;
+    }
+  }
+  return retlen + cnt7 + (cnt7 != 0 ? 1 : 0);
+}
+
+static size_t reference_sysex_to_data(const uint8_t *sysex, uint8_t *data, size_t len){
+  size_t cnt2 = 0;
+  uint8_t bits = 0;
+  for(size_t cnt = 0; cnt < len; cnt++) {
+    if((cnt % 8) == 0) {
+      bits = sysex[cnt];
+    }else{
+      data[cnt2++] = sysex[cnt] | ((bits & 1) << 7);
+      bits >>= 1;
+    }
+  }
+  return cnt2;
+}
+
+#define MAX_SIZE 4096
+#define BENCHMARK_SIZE (64*1024)
+#define BENCHMARK_REPEATS 200
+
+static uint8_t data[MAX_SIZE+8];
+static uint8_t sysex[MAX_SIZE/7*8+16];
+static uint8_t expected[MAX_SIZE/7*8+16];
+static uint8_t decoded[MAX_SIZE+8];
+static uint8_t reference[MAX_SIZE+8];
+
+static void testRoundTrip(){
+  srand(31);
+  for(int i=0; i<20000; ++i){
+    size_t len = rand() % (i < 1000 ? 32 : MAX_SIZE);
+    size_t offset = rand() % 4; // unaligned buffers
+    for(size_t j=0; j<len; ++j)
+      data[offset+j] = rand();
+    memset(sysex, 0xaa, sizeof(sysex));
+    size_t n = data_to_sysex(data+offset, sysex+offset, len);
+    size_t m = reference_data_to_sysex(data+offset, expected+offset, len);
+    CHECK_EQUAL(n, m);
+    CHECK(memcmp(sysex+offset, expected+offset, n) == 0);
+    CHECK_EQUAL(sysex[offset+n], 0xaa); // nothing written past the end
+    bool clean = true;
+    for(size_t j=0; j<n; ++j)
+      clean &= sysex[offset+j] < 0x80;
+    CHECK(clean);
+    memset(decoded, 0x55, sizeof(decoded));
+    CHECK_EQUAL(sysex_to_data(sysex+offset, decoded, n), len);
+    CHECK(memcmp(decoded, data+offset, len) == 0);
+    CHECK_EQUAL(decoded[len], 0x55);
+  }
+}
+
+/* any 7-bit input, including truncated groups, decodes as it did before */
+static void testDecodeArbitrary(){
+  srand(32);
+  for(int i=0; i<20000; ++i){
+    size_t len = rand() % 64;
+    for(size_t j=0; j<len; ++j)
+      sysex[j] = rand() & 0x7f;
+    size_t n = sysex_to_data(sysex, decoded, len);
+    size_t m = reference_sysex_to_data(sysex, reference, len);
+    CHECK_EQUAL(n, m);
+    CHECK(memcmp(decoded, reference, n) == 0);
+  }
+}
+
+static void benchmark(){
+  static uint8_t in[BENCHMARK_SIZE];
+  static uint8_t out[BENCHMARK_SIZE/7*8+16];
+  static uint8_t back[BENCHMARK_SIZE+8];
+  for(size_t i=0; i<BENCHMARK_SIZE; ++i)
+    in[i] = rand();
+  size_t n = 0;
+  double t0 = getSeconds();
+  for(int r=0; r<BENCHMARK_REPEATS; ++r)
+    n = data_to_sysex(in, out, BENCHMARK_SIZE);
+  double t1 = getSeconds();
+  for(int r=0; r<BENCHMARK_REPEATS; ++r)
+    reference_data_to_sysex(in, out, BENCHMARK_SIZE);
+  double t2 = getSeconds();
+  for(int r=0; r<BENCHMARK_REPEATS; ++r)
+    sysex_to_data(out, back, n);
+  double t3 = getSeconds();
+  for(int r=0; r<BENCHMARK_REPEATS; ++r)
+    reference_sysex_to_data(out, back, n);
+  double t4 = getSeconds();
+  CHECK(memcmp(in, back, BENCHMARK_SIZE) == 0);
+  double mb = BENCHMARK_SIZE*(double)BENCHMARK_REPEATS/1e6;
+  printf("encode: %.1f MB/s, byte-wise %.1f MB/s\n", mb/(t1-t0), mb/(t2-t1));
+  printf("decode: %.1f MB/s, byte-wise %.1f MB/s\n", mb/(t3-t2), mb/(t4-t3));
+}
+
+int main(){
+  testRoundTrip();
+  testDecodeArbitrary();
+  benchmark();
+  return testResult("SysexTest");
+}
@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <math.h>
+#include "Test.h"
+#include "TempoTracker.h"
+
+/*
+ * The delay locked loops of TempoTracker, fed with MIDI clock and taps
+ * with random timing jitter: the tempo must settle close to the true one
+ * and follow tempo changes, and the beat phase must stay with the beat.
+ */
+
+/* uniform jitter of up to +/- us microseconds */
+static int32_t jitter(int32_t us){
+  return us ? rand() % (2*us+1) - us : 0;
+}
+
+static double relativeError(float bpm, float expected){
+  return fabs(bpm - expected)/expected;
+}
+
+/* send MIDI clock at a tempo for a number of beats, from time t; returns the time after */
+static uint32_t sendClock(TempoTracker& tracker, uint32_t t, float bpm, int beats, int32_t us){
+  float period = 60000000.0f/bpm/TEMPO_CLOCKS_PER_BEAT;
+  for(int i=0; i<beats*TEMPO_CLOCKS_PER_BEAT; ++i){
+    uint32_t now = t + (uint32_t)(i*period);
+    tracker.clock(now + jitter(us));
+  }
+  return t + (uint32_t)(beats*TEMPO_CLOCKS_PER_BEAT*period);
+}
+
+static void testClock(){
+  TempoTracker tracker;
+  srand(42);
+  CHECK(tracker.getBeatsPerMinute(0) == 0.0f);
+  uint32_t t = 1000000;
+  t = sendClock(tracker, t, 120, 16, 1000);
+  CHECK(relativeError(tracker.getBeatsPerMinute(t), 120) < 0.005);
+  // the jitter of a single clock is filtered out: the estimate hardly moves
+  double worst = 0;
+  for(int i=0; i<32; ++i){
+    t = sendClock(tracker, t, 120, 1, 1000);
+    double e = relativeError(tracker.getBeatsPerMinute(t), 120);
+    worst = e > worst ? e : worst;
+  }
+  CHECK(worst < 0.005);
+  // a tempo change is followed within a few beats
+  t = sendClock(tracker, t, 140, 8, 1000);
+  CHECK(relativeError(tracker.getBeatsPerMinute(t), 140) < 0.005);
+  // the tempo is forgotten when the clock stops
+  CHECK(tracker.getBeatsPerMinute(t + TEMPO_TIMEOUT_US + 1) == 0.0f);
+}
+
+static void testBeatPhase(){
+  TempoTracker tracker;
+  srand(43);
+  uint32_t t = 0;
+  tracker.start();
+  t = sendClock(tracker, t, 100, 8, 500);
+  // t is where the next beat starts: just before it the phase is near 1
+  float period = 60000000.0f/100;
+  float phase = tracker.getBeatPhase(t - (uint32_t)(period/TEMPO_CLOCKS_PER_BEAT) + 100);
+  CHECK(phase > 0.95f);
+  // a quarter of the way through the next beat
+  tracker.clock(t);
+  for(int i=1; i<=TEMPO_CLOCKS_PER_BEAT/4; ++i)
+    tracker.clock(t + (uint32_t)(i*period/TEMPO_CLOCKS_PER_BEAT) + jitter(500));
+  phase = tracker.getBeatPhase(t + (uint32_t)(period/4) + 1000);
+  CHECK(fabs(phase - 0.25f - 1000/period) < 0.02);
+}
+
+static void testTap(){
+  TempoTracker tracker;
+  srand(44);
+  uint32_t t = 0;
+  // taps by hand are off by up to 20ms
+  for(int i=0; i<8; ++i){
+    t += 500000;
+    tracker.tap(t + jitter(20000));
+  }
+  CHECK(relativeError(tracker.getBeatsPerMinute(t), 120) < 0.05);
+  // a new tempo is picked up within ten taps, after some overshoot
+  for(int i=0; i<10; ++i){
+    t += 400000;
+    tracker.tap(t + jitter(20000));
+  }
+  CHECK(relativeError(tracker.getBeatsPerMinute(t), 150) < 0.05);
+  // taps are ignored while MIDI clock runs
+  t = sendClock(tracker, t, 90, 4, 0);
+  tracker.tap(t);
+  CHECK(relativeError(tracker.getBeatsPerMinute(t), 90) < 0.005);
+}
+
+int main(){
+  testClock();
+  testBeatPhase();
+  testTap();
+  return testResult("TempoTrackerTest");
+}
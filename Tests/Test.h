@@ -0,0 +1,37 @@
+#ifndef __Test_h__
+#define __Test_h__
+
+#include <stdio.h>
+#include <time.h>
+
+/*
+ * Minimal assertions for the host tests. A failed check is reported and
+ * counted, and the test carries on so that one run shows every failure.
+ */
+static int testFailures = 0;
+
+#define CHECK(cond) do{ if(!(cond)){					\
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);	\
+      testFailures++; } }while(0)
+
+#define CHECK_EQUAL(a, b) do{ long long _a = (a), _b = (b); if(_a != _b){ \
+      printf("%s:%d: CHECK_EQUAL(%s, %s) failed: %lld != %lld\n",	\
+	     __FILE__, __LINE__, #a, #b, _a, _b);			\
+      testFailures++; } }while(0)
+
+/* monotonic time in seconds, for benchmarks */
+static inline double getSeconds(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static inline int testResult(const char* name){
+  if(testFailures)
+    printf("%s: %d failures\n", name, testFailures);
+  else
+    printf("%s: passed\n", name);
+  return testFailures ? 1 : 0;
+}
+
+#endif // __Test_h__
@@ -0,0 +1,12 @@
+#ifndef __STM32F4xx_H
+#define __STM32F4xx_H
+
+/* the few definitions from the device header that host tested code uses */
+
+#include <stdint.h>
+
+#define I2S_Standard_Phillips           ((uint16_t)0x0000)
+#define I2S_Standard_MSB                ((uint16_t)0x0010)
+#define I2S_Standard_LSB                ((uint16_t)0x0020)
+
+#endif /* __STM32F4xx_H */